@@ -0,0 +1,216 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Asymmetric per-key debounce (eager on key press, deferred on key release)
+// with the debounce time selected separately for every key.  Every key starts
+// with the short ADAPTIVE_DEBOUNCE_MIN time; every ADAPTIVE_DEBOUNCE_THRESHOLD
+// chatter events detected for a key (the key is pressed again too soon after
+// being released) increase the debounce time for that key by
+// ADAPTIVE_DEBOUNCE_STEP, up to DEBOUNCE.  A single fast repeated press (e.g.,
+// a double letter typed quickly) therefore does not change the debounce time.
+// The chatter count for a key is halved after ADAPTIVE_DEBOUNCE_DECAY clean
+// presses of that key, so that the debounce time goes back down if the
+// chatter stops.  The chatter counts for all keys are stored in the user
+// settings.
+
+#include "adaptive_debounce.h"
+#include "debounce.h"
+#include "timer.h"
+#include "user_settings.h"
+
+#ifndef DEBOUNCE
+#    define DEBOUNCE 30
+#endif
+
+#ifndef ADAPTIVE_DEBOUNCE_MIN
+#    define ADAPTIVE_DEBOUNCE_MIN 5
+#endif
+
+#ifndef ADAPTIVE_DEBOUNCE_STEP
+#    define ADAPTIVE_DEBOUNCE_STEP 5
+#endif
+
+// Number of chatter events which increase the debounce time by one step.
+#ifndef ADAPTIVE_DEBOUNCE_THRESHOLD
+#    define ADAPTIVE_DEBOUNCE_THRESHOLD 3
+#endif
+
+// Number of clean presses after which the chatter count for a key is halved.
+#ifndef ADAPTIVE_DEBOUNCE_DECAY
+#    define ADAPTIVE_DEBOUNCE_DECAY 200
+#endif
+
+// Key presses which come sooner than this after the release of the same key
+// are considered to be chatter.
+#ifndef ADAPTIVE_DEBOUNCE_CHATTER_INTERVAL
+#    define ADAPTIVE_DEBOUNCE_CHATTER_INTERVAL 40
+#endif
+
+// Maximum debounce time is limited by the size of `debounce_counter_t.time`.
+#if DEBOUNCE > 127
+#    error "DEBOUNCE must not be greater than 127"
+#endif
+
+#if ADAPTIVE_DEBOUNCE_MIN > DEBOUNCE
+#    error "ADAPTIVE_DEBOUNCE_MIN must not be greater than DEBOUNCE"
+#endif
+
+#if ADAPTIVE_DEBOUNCE_DECAY > 255
+#    error "ADAPTIVE_DEBOUNCE_DECAY must not be greater than 255"
+#endif
+
+// Chatter count at which the debounce time reaches DEBOUNCE.
+#define ADAPTIVE_DEBOUNCE_MAX_CHATTER_COUNT (((DEBOUNCE - ADAPTIVE_DEBOUNCE_MIN + ADAPTIVE_DEBOUNCE_STEP - 1) / ADAPTIVE_DEBOUNCE_STEP) * ADAPTIVE_DEBOUNCE_THRESHOLD)
+
+#if ADAPTIVE_DEBOUNCE_MAX_CHATTER_COUNT > 255
+#    error "ADAPTIVE_DEBOUNCE_THRESHOLD is too large for the chatter count range"
+#endif
+
+#define DEBOUNCE_ELAPSED 0
+
+typedef struct {
+    bool    pressed : 1;
+    uint8_t time : 7;
+} debounce_counter_t;
+
+static debounce_counter_t debounce_counters[MATRIX_ROWS][MATRIX_COLS];
+static bool               counters_need_update;
+static uint8_t            clean_presses[MATRIX_ROWS][MATRIX_COLS];
+
+static uint8_t get_debounce_time(uint8_t row, uint8_t col) {
+    uint16_t time = ADAPTIVE_DEBOUNCE_MIN + (uint16_t)(user_config.chatter_count[row][col] / ADAPTIVE_DEBOUNCE_THRESHOLD) * ADAPTIVE_DEBOUNCE_STEP;
+    return time < DEBOUNCE ? time : DEBOUNCE;
+}
+
+uint8_t adaptive_debounce_max_chatter_count(void) {
+    return ADAPTIVE_DEBOUNCE_MAX_CHATTER_COUNT;
+}
+
+void debounce_init(uint8_t num_rows) {
+    memset(debounce_counters, 0, sizeof(debounce_counters));
+    counters_need_update = false;
+}
+
+void debounce_free(void) {}
+
+static bool update_debounce_counters(matrix_row_t raw[], matrix_row_t cooked[], uint8_t num_rows, uint8_t elapsed_time, bool *matrix_need_update) {
+    bool cooked_changed  = false;
+    counters_need_update = false;
+    for (uint8_t row = 0; row < num_rows; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            debounce_counter_t *counter = &debounce_counters[row][col];
+            if (counter->time == DEBOUNCE_ELAPSED) {
+                continue;
+            }
+            if (counter->time > elapsed_time) {
+                counter->time -= elapsed_time;
+                counters_need_update = true;
+                continue;
+            }
+            counter->time = DEBOUNCE_ELAPSED;
+            if (counter->pressed) {
+                // Key press lockout has expired; the key state may need to be
+                // updated if it was released during the lockout period.
+                *matrix_need_update = true;
+            } else {
+                // Key release delay has expired; report the release.
+                matrix_row_t col_mask    = (matrix_row_t)1 << col;
+                matrix_row_t cooked_next = (cooked[row] & ~col_mask) | (raw[row] & col_mask);
+                cooked_changed |= cooked_next ^ cooked[row];
+                cooked[row] = cooked_next;
+            }
+        }
+    }
+    return cooked_changed;
+}
+
+static bool transfer_matrix_values(matrix_row_t raw[], matrix_row_t cooked[], uint8_t num_rows) {
+    bool cooked_changed = false;
+    for (uint8_t row = 0; row < num_rows; row++) {
+        matrix_row_t delta = raw[row] ^ cooked[row];
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            debounce_counter_t *counter  = &debounce_counters[row][col];
+            matrix_row_t        col_mask = (matrix_row_t)1 << col;
+            if (delta & col_mask) {
+                if (counter->time == DEBOUNCE_ELAPSED) {
+                    counter->pressed     = (raw[row] & col_mask) != 0;
+                    counter->time        = get_debounce_time(row, col);
+                    counters_need_update = true;
+                    if (counter->pressed) {
+                        // Report the key press immediately.
+                        cooked[row] ^= col_mask;
+                        cooked_changed = true;
+                    }
+                }
+            } else if (counter->time != DEBOUNCE_ELAPSED && !counter->pressed) {
+                // The key was pressed again before the release delay expired.
+                counter->time = DEBOUNCE_ELAPSED;
+            }
+        }
+    }
+    return cooked_changed;
+}
+
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], uint8_t num_rows, bool changed) {
+    static fast_timer_t last_time;
+
+    bool cooked_changed     = false;
+    bool updated_last       = false;
+    bool matrix_need_update = false;
+
+    if (counters_need_update) {
+        fast_timer_t now          = timer_read_fast();
+        fast_timer_t elapsed_time = TIMER_DIFF_FAST(now, last_time);
+
+        last_time    = now;
+        updated_last = true;
+        if (elapsed_time > UINT8_MAX) {
+            elapsed_time = UINT8_MAX;
+        }
+        if (elapsed_time > 0) {
+            cooked_changed |= update_debounce_counters(raw, cooked, num_rows, elapsed_time, &matrix_need_update);
+        }
+    }
+
+    if (changed || matrix_need_update) {
+        if (!updated_last) {
+            last_time = timer_read_fast();
+        }
+        cooked_changed |= transfer_matrix_values(raw, cooked, num_rows);
+    }
+
+    return cooked_changed;
+}
+
+bool adaptive_debounce_record(keyrecord_t *record) {
+    static keypos_t last_released_key = {.row = UINT8_MAX, .col = UINT8_MAX};
+    static uint16_t last_release_time;
+
+    bool     chatter = false;
+    keypos_t key     = record->event.key;
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) {
+        return false;
+    }
+
+    if (!record->event.pressed) {
+        last_released_key = key;
+        last_release_time = record->event.time;
+        return false;
+    }
+
+    uint8_t *count = &user_config.chatter_count[key.row][key.col];
+    if (key.row == last_released_key.row && key.col == last_released_key.col && TIMER_DIFF_16(record->event.time, last_release_time) < ADAPTIVE_DEBOUNCE_CHATTER_INTERVAL) {
+        chatter                         = true;
+        clean_presses[key.row][key.col] = 0;
+        if (get_debounce_time(key.row, key.col) < DEBOUNCE) {
+            ++*count;
+            user_settings_save();
+        }
+    } else if (*count > 0 && ++clean_presses[key.row][key.col] >= ADAPTIVE_DEBOUNCE_DECAY) {
+        clean_presses[key.row][key.col] = 0;
+        *count /= 2;
+        user_settings_save();
+    }
+    last_released_key.row = UINT8_MAX;
+    return chatter;
+}
@@ -0,0 +1,14 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Update the chatter statistics using the key event; returns true if the
+// event is a key press which was detected as chatter.
+bool adaptive_debounce_record(keyrecord_t *record);
+
+// Return the maximum chatter count which can be reached for a key (the chatter
+// count stops increasing when the debounce time reaches DEBOUNCE).
+uint8_t adaptive_debounce_max_chatter_count(void);
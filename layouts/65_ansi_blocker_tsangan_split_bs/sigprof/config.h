@@ -2,5 +2,45 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #define HOLD_ON_OTHER_KEY_PRESS_PER_KEY
+#define TAPPING_TERM_PER_KEY
 
+// Maximum debounce time (the actual per-key debounce time is selected by
+// adaptive_debounce.c, starting from ADAPTIVE_DEBOUNCE_MIN).
 #define DEBOUNCE 30
+#define ADAPTIVE_DEBOUNCE_MIN 5
+
+// Combos (see `key_combos[]` in keymap.c); the combo term is kept short,
+// because it delays the first key of the combos.
+#define COMBO_TERM 30
+#define COMBO_TERM_PER_COMBO
+#define COMBO_HOLD_TERM 1000
+#define COMBO_MUST_HOLD_PER_COMBO
+#define COMBO_MUST_PRESS_IN_ORDER_PER_COMBO
+#define COMBO_ONLY_FROM_LAYER 0
+
+// Layer and language switch mode indicators (see `rgb_layers[]` in keymap.c).
+#ifdef RGBLIGHT_ENABLE
+#    define RGBLIGHT_LAYERS
+#    define RGBLIGHT_LAYERS_OVERRIDE_RGB_OFF
+#    define RGBLIGHT_MAX_LAYERS 9
+#endif
+
+// Settings store (user_settings.c), recorded macros (macro_recorder.c),
+// keymap overrides (keymap_overrides.c) and optional usage counters
+// (key_stats.c) in the EEPROM user datablock.  The datablock version must not
+// depend on its size, otherwise the stored settings would be discarded
+// whenever the size is changed.  The usage counters are kept only in RAM on
+// AVR, where the whole EEPROM is too small for them.
+#define USER_SETTINGS_SLOT_SIZE 128
+#define USER_SETTINGS_SLOT_COUNT 2
+#define MACRO_SLOT_SIZE 128
+#define MACRO_SLOT_COUNT 4
+#define KEYMAP_OVERRIDE_COUNT 16
+#define KEYMAP_OVERRIDES_STORAGE_SIZE 72
+#if defined(KEY_STATS_ENABLE) && !defined(__AVR__)
+#    define KEY_STATS_STORAGE_SIZE 832
+#else
+#    define KEY_STATS_STORAGE_SIZE 0
+#endif
+#define EECONFIG_USER_DATA_SIZE (USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + MACRO_SLOT_SIZE * MACRO_SLOT_COUNT + KEYMAP_OVERRIDES_STORAGE_SIZE + KEY_STATS_STORAGE_SIZE)
+#define EECONFIG_USER_DATA_VERSION 1
@@ -0,0 +1,128 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Fixed-size event trace buffer (built if CONSOLE_ENABLE or RAW_ENABLE is
+// set).  Key events are appended to the buffer from the key processing path,
+// and the buffer is drained either by the host over raw HID (see
+// event_trace_read()), or to the console from the housekeeping task, one
+// record per call and only when there was no input activity for
+// EVENT_TRACE_IDLE_DELAY ms, so that printing does not add any work to the
+// main loop while keys are being typed.  If the buffer is full, new records
+// are dropped (and the number of dropped records is reported together with
+// the next drained record).
+//
+// Every record drained to the console is printed as a single line:
+//
+//     evt <time> <keycode> <d|u> <layer_state> <+dt>
+//
+// where <+dt> is the time since the previous event for the same keycode if
+// that event was the previous record (this makes key chatter easy to spot).
+
+#include "event_trace.h"
+#include "print.h"
+
+// Number of records in the trace buffer (must be a power of 2).
+#ifndef EVENT_TRACE_SIZE
+#    define EVENT_TRACE_SIZE 32
+#endif
+
+// Time without input activity after which the buffer is drained.
+#ifndef EVENT_TRACE_IDLE_DELAY
+#    define EVENT_TRACE_IDLE_DELAY 100
+#endif
+
+#if (EVENT_TRACE_SIZE & (EVENT_TRACE_SIZE - 1)) != 0 || EVENT_TRACE_SIZE > 128
+#    error "EVENT_TRACE_SIZE must be a power of 2 not greater than 128"
+#endif
+
+#define EVENT_TRACE_MASK (EVENT_TRACE_SIZE - 1)
+
+typedef struct {
+    layer_state_t layer_state;
+    uint16_t      keycode;
+    uint16_t      time;
+    bool          pressed;
+} event_trace_record_t;
+
+static event_trace_record_t event_trace_buffer[EVENT_TRACE_SIZE];
+
+// The producer (event_trace_record()) modifies only `event_trace_head`, and the
+// consumers (event_trace_task() and event_trace_read(), both called from the
+// main loop) modify only `event_trace_tail`; both indexes are single bytes, so
+// they are updated atomically even on AVR.
+static volatile uint8_t event_trace_head;
+static volatile uint8_t event_trace_tail;
+static uint8_t          event_trace_dropped;
+
+void event_trace_record(uint16_t keycode, keyrecord_t *record) {
+    uint8_t head = event_trace_head;
+    if ((uint8_t)(head - event_trace_tail) >= EVENT_TRACE_SIZE) {
+        if (event_trace_dropped < UINT8_MAX) {
+            ++event_trace_dropped;
+        }
+        return;
+    }
+
+    event_trace_record_t *entry = &event_trace_buffer[head & EVENT_TRACE_MASK];
+    entry->layer_state          = layer_state;
+    entry->keycode              = keycode;
+    entry->time                 = record->event.time;
+    entry->pressed              = record->event.pressed;
+    event_trace_head            = head + 1;
+}
+
+uint8_t event_trace_read(uint8_t *data, uint8_t size, uint8_t *dropped) {
+    uint8_t tail  = event_trace_tail;
+    uint8_t count = 0;
+
+    *dropped            = event_trace_dropped;
+    event_trace_dropped = 0;
+    while (tail != event_trace_head && size >= EVENT_TRACE_RECORD_SIZE) {
+        const event_trace_record_t *entry = &event_trace_buffer[tail & EVENT_TRACE_MASK];
+
+        data[0] = entry->time & 0xff;
+        data[1] = entry->time >> 8;
+        data[2] = entry->keycode & 0xff;
+        data[3] = entry->keycode >> 8;
+        data[4] = entry->pressed;
+        for (uint8_t i = 0; i < 4; ++i) {
+            data[5 + i] = (uint32_t)entry->layer_state >> (8 * i);
+        }
+        data += EVENT_TRACE_RECORD_SIZE;
+        size -= EVENT_TRACE_RECORD_SIZE;
+        ++count;
+        ++tail;
+    }
+    event_trace_tail = tail;
+    return count;
+}
+
+#ifdef CONSOLE_ENABLE
+void event_trace_task(void) {
+    static uint16_t last_keycode;
+    static uint16_t last_time;
+    static bool     last_valid;
+
+    uint8_t tail = event_trace_tail;
+    if (tail == event_trace_head || last_input_activity_elapsed() < EVENT_TRACE_IDLE_DELAY) {
+        return;
+    }
+
+    const event_trace_record_t *entry = &event_trace_buffer[tail & EVENT_TRACE_MASK];
+    if (event_trace_dropped) {
+        uprintf("evt dropped %u\n", (unsigned)event_trace_dropped);
+        event_trace_dropped = 0;
+        last_valid          = false;
+    }
+    if (last_valid && entry->keycode == last_keycode) {
+        uprintf("evt %5u %04X %c %08lX +%u\n", (unsigned)entry->time, (unsigned)entry->keycode, entry->pressed ? 'd' : 'u', (unsigned long)entry->layer_state, (unsigned)(uint16_t)(entry->time - last_time));
+    } else {
+        uprintf("evt %5u %04X %c %08lX\n", (unsigned)entry->time, (unsigned)entry->keycode, entry->pressed ? 'd' : 'u', (unsigned long)entry->layer_state);
+    }
+
+    last_keycode     = entry->keycode;
+    last_time        = entry->time;
+    last_valid       = true;
+    event_trace_tail = tail + 1;
+}
+#endif
@@ -0,0 +1,24 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Append the key event to the trace buffer (safe to call on the key
+// processing path; never waits for the console).
+void event_trace_record(uint16_t keycode, keyrecord_t *record);
+
+// Size of a record returned by event_trace_read(): time (LE16), keycode
+// (LE16), pressed (0 or 1), layer state (LE32).
+#define EVENT_TRACE_RECORD_SIZE 9
+
+// Remove as many buffered trace records as fit into `size` bytes and store
+// them into `data`; returns the number of records.  `*dropped` is set to the
+// number of records dropped since the previous read (saturated at 255).
+uint8_t event_trace_read(uint8_t *data, uint8_t size, uint8_t *dropped);
+
+#ifdef CONSOLE_ENABLE
+// Send one buffered trace record to the console if the keyboard is idle.
+void event_trace_task(void);
+#endif
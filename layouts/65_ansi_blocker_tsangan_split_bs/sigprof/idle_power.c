@@ -0,0 +1,119 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Lower power consumption when the keyboard is idle.  If there was no input
+// activity for `user_config.idle_timeout` minutes, the RGB lighting and the
+// backlight are turned off, and the MCU sleeps for IDLE_SCAN_DELAY ms in every
+// main loop iteration, which lowers the matrix scan rate (on AVR the CPU is
+// put into the idle sleep mode and woken up by the 1 ms timer interrupt; on
+// ChibiOS the thread sleeps, so the RTOS may put the MCU into a low power
+// state; other platforms just wait).  The matrix is still
+// scanned, so the first key press is not lost: it is seen by the next scan
+// (at most IDLE_SCAN_DELAY ms later), and the resulting input activity
+// restores the full scan rate and the lighting.  The timeout is selected by
+// the U_IDLE key or by the raw HID settings command.
+
+#include "idle_power.h"
+#include "user_settings.h"
+
+#if defined(__AVR__)
+#    include <avr/sleep.h>
+#elif defined(PROTOCOL_CHIBIOS)
+#    include <ch.h>
+#endif
+
+#ifndef IDLE_TIMEOUT_DEFAULT
+#    define IDLE_TIMEOUT_DEFAULT 10
+#endif
+
+#ifndef IDLE_SCAN_DELAY
+#    define IDLE_SCAN_DELAY 10
+#endif
+
+static bool is_idle;
+
+// Timeouts selected by idle_power_next_timeout() (0 = IDLE_TIMEOUT_DEFAULT).
+static const uint8_t PROGMEM idle_timeouts[] = {0, 5, 30, IDLE_TIMEOUT_NEVER};
+
+static uint32_t idle_timeout_ms(void) {
+    switch (user_config.idle_timeout) {
+        case 0:
+            return IDLE_TIMEOUT_DEFAULT * 60000UL;
+        case IDLE_TIMEOUT_NEVER:
+            return UINT32_MAX;
+        default:
+            return user_config.idle_timeout * 60000UL;
+    }
+}
+
+static void set_lighting_suspended(bool suspended) {
+#ifdef RGBLIGHT_ENABLE
+    if (suspended) {
+        rgblight_suspend();
+    } else {
+        rgblight_wakeup();
+    }
+#endif
+#ifdef RGB_MATRIX_ENABLE
+    rgb_matrix_set_suspend_state(suspended);
+#endif
+#ifdef BACKLIGHT_ENABLE
+    backlight_set(suspended || !is_backlight_enabled() ? 0 : get_backlight_level());
+#endif
+}
+
+static void idle_sleep(void) {
+#if defined(__AVR__)
+    uint16_t start = timer_read();
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (timer_elapsed(start) < IDLE_SCAN_DELAY) {
+        sleep_enable();
+        sleep_cpu();
+        sleep_disable();
+    }
+#elif defined(PROTOCOL_CHIBIOS)
+    chThdSleepMilliseconds(IDLE_SCAN_DELAY);
+#else
+    wait_ms(IDLE_SCAN_DELAY);
+#endif
+}
+
+bool idle_power_is_idle(void) {
+    return is_idle;
+}
+
+bool idle_power_task(void) {
+    bool idle    = last_input_activity_elapsed() >= idle_timeout_ms();
+    bool changed = idle != is_idle;
+
+    if (changed) {
+        is_idle = idle;
+        set_lighting_suspended(idle);
+    }
+    if (is_idle) {
+        idle_sleep();
+    }
+    return changed;
+}
+
+void idle_power_wakeup(void) {
+    if (is_idle) {
+        set_lighting_suspended(true);
+    }
+}
+
+void idle_power_next_timeout(void) {
+    uint8_t next = 0;
+
+    // A timeout which is not in the list (set by raw HID) selects the first
+    // one.
+    for (uint8_t i = 0; i < ARRAY_SIZE(idle_timeouts); ++i) {
+        if (pgm_read_byte(&idle_timeouts[i]) == user_config.idle_timeout) {
+            next = (i + 1) % ARRAY_SIZE(idle_timeouts);
+            break;
+        }
+    }
+    user_config.idle_timeout = pgm_read_byte(&idle_timeouts[next]);
+    user_settings_save();
+}
@@ -0,0 +1,23 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Enter or leave the idle mode depending on the input activity and throttle
+// the matrix scanning while idle (must be called at the end of the
+// housekeeping task).  Returns true if the idle mode was entered or left.
+bool idle_power_task(void);
+
+// Return true if the keyboard is in the idle mode.
+bool idle_power_is_idle(void);
+
+// Turn the lighting off again if the keyboard is still idle after a USB
+// resume, which turns it on in the QMK core (must be called from
+// suspend_wakeup_init_user()).
+void idle_power_wakeup(void);
+
+// Select the next idle timeout from `idle_timeouts[]` (the current timeout
+// is kept in `user_config.idle_timeout`, which is saved).
+void idle_power_next_timeout(void);
@@ -0,0 +1,125 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Optional usage counters (enabled by `KEY_STATS_ENABLE = yes`):
+// - key presses for every layout position on every layer;
+// - chatter events for every layout position;
+// - tap dance branches and language switch paths.
+// The counters saturate instead of overflowing (see key_stats_counter_t for
+// their size), so that a counter which reached the maximum value is visibly
+// not accurate anymore and other counters are not affected.  The counters
+// are kept in RAM and written to the EEPROM user datablock (after the keymap
+// overrides) every KEY_STATS_FLUSH_INTERVAL ms if they were changed, but only
+// when there was no input activity for KEY_STATS_IDLE_DELAY ms (if
+// KEY_STATS_STORAGE_SIZE is 0, the counters are kept only in RAM).  The table
+// can be read over raw HID (see `raw_hid_receive()` in keymap.c).
+
+#include "key_stats.h"
+#include "eeconfig.h"
+
+#define KEY_STATS_VERSION 1
+
+#ifndef KEY_STATS_FLUSH_INTERVAL
+#    define KEY_STATS_FLUSH_INTERVAL 600000
+#endif
+
+#ifndef KEY_STATS_IDLE_DELAY
+#    define KEY_STATS_IDLE_DELAY 3000
+#endif
+
+typedef struct {
+    key_stats_counter_t presses[KEY_STATS_LAYERS][KEY_STATS_POSITIONS];
+    key_stats_counter_t chatter[KEY_STATS_POSITIONS];
+    key_stats_counter_t events[KEY_STATS_EVENTS];
+} key_stats_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t checksum;
+} key_stats_header_t;
+
+#if KEY_STATS_STORAGE_SIZE > 0
+_Static_assert(sizeof(key_stats_header_t) + sizeof(key_stats_t) <= KEY_STATS_STORAGE_SIZE, "KEY_STATS_STORAGE_SIZE is too small");
+_Static_assert(USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + MACRO_SLOT_SIZE * MACRO_SLOT_COUNT + KEYMAP_OVERRIDES_STORAGE_SIZE + KEY_STATS_STORAGE_SIZE <= EECONFIG_USER_DATA_SIZE, "EECONFIG_USER_DATA_SIZE is too small for the key statistics");
+#endif
+
+static key_stats_t key_stats;
+static bool        key_stats_dirty;
+static uint32_t    key_stats_flush_time;
+
+// Offset of the counters in the user datablock.
+#define STORAGE_OFFSET (USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + MACRO_SLOT_SIZE * MACRO_SLOT_COUNT + KEYMAP_OVERRIDES_STORAGE_SIZE)
+
+static uint8_t key_stats_checksum(void) {
+    const uint8_t *data  = (const uint8_t *)&key_stats;
+    uint8_t        check = KEY_STATS_VERSION;
+
+    for (uint16_t i = 0; i < sizeof(key_stats); ++i) {
+        check = ((check << 1) | (check >> 7)) ^ data[i];
+    }
+    return check;
+}
+
+void key_stats_init(void) {
+    key_stats_header_t header;
+
+    key_stats_flush_time = timer_read32();
+    if (KEY_STATS_STORAGE_SIZE == 0) {
+        return;
+    }
+    eeconfig_read_user_datablock(&header, STORAGE_OFFSET, sizeof(header));
+    eeconfig_read_user_datablock(&key_stats, STORAGE_OFFSET + sizeof(header), sizeof(key_stats));
+    if (header.version != KEY_STATS_VERSION || header.checksum != key_stats_checksum()) {
+        memset(&key_stats, 0, sizeof(key_stats));
+    }
+}
+
+static void increment(key_stats_counter_t *counter) {
+    if (*counter != (key_stats_counter_t)~0) {
+        ++*counter;
+        key_stats_dirty = true;
+    }
+}
+
+void key_stats_record_press(uint8_t layer, uint8_t position) {
+    if (layer < KEY_STATS_LAYERS && position < KEY_STATS_POSITIONS) {
+        increment(&key_stats.presses[layer][position]);
+    }
+}
+
+void key_stats_record_chatter(uint8_t position) {
+    if (position < KEY_STATS_POSITIONS) {
+        increment(&key_stats.chatter[position]);
+    }
+}
+
+void key_stats_record_event(uint8_t event) {
+    if (event < KEY_STATS_EVENTS) {
+        increment(&key_stats.events[event]);
+    }
+}
+
+void key_stats_task(void) {
+    if (KEY_STATS_STORAGE_SIZE == 0 || !key_stats_dirty || timer_elapsed32(key_stats_flush_time) < KEY_STATS_FLUSH_INTERVAL || last_input_activity_elapsed() < KEY_STATS_IDLE_DELAY) {
+        return;
+    }
+
+    key_stats_header_t header = {.version = KEY_STATS_VERSION, .checksum = key_stats_checksum()};
+    eeconfig_update_user_datablock(&key_stats, STORAGE_OFFSET + sizeof(header), sizeof(key_stats));
+    eeconfig_update_user_datablock(&header, STORAGE_OFFSET, sizeof(header));
+    key_stats_dirty      = false;
+    key_stats_flush_time = timer_read32();
+}
+
+void key_stats_read(uint16_t offset, uint8_t *data, uint8_t size) {
+    const uint8_t *table = (const uint8_t *)&key_stats;
+
+    for (uint8_t i = 0; i < size; ++i, ++offset) {
+        data[i] = offset < sizeof(key_stats) ? table[offset] : 0;
+    }
+}
+
+void key_stats_reset(void) {
+    memset(&key_stats, 0, sizeof(key_stats));
+    key_stats_dirty = true;
+}
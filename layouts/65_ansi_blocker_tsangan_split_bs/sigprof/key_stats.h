@@ -0,0 +1,54 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Number of layout positions (in the order of LAYOUT_65_ansi_blocker_tsangan_split_bs()
+// arguments) and layers in the press counter table.
+#define KEY_STATS_POSITIONS 67
+#define KEY_STATS_LAYERS 5
+
+// Counters saturate at the maximum value.  They are 16-bit (8-bit on AVR,
+// where RAM is scarce and the counters are not stored in EEPROM); the counter
+// size is reported by the raw HID protocol, the byte order is little-endian.
+#ifdef __AVR__
+typedef uint8_t key_stats_counter_t;
+#else
+typedef uint16_t key_stats_counter_t;
+#endif
+
+// Counted events other than key presses.
+enum key_stats_events {
+    KEY_STATS_TD_RCTL,                       // TD_RCTL states (`enum td_rctl_state`)
+    KEY_STATS_RALTG = KEY_STATS_TD_RCTL + 4, // U_RALTG presses with 1, 2 and 3 taps
+    KEY_STATS_LSW_KEY = KEY_STATS_RALTG + 3, // language switch by U_LSW or U_LSWS
+    KEY_STATS_LSW_SHIFT_TAP_DANCE,           // language switch by TD_LSFT or TD_RSFT
+    KEY_STATS_LSW_MOD_TAP,                   // language switch by U_LSFTL or U_RSFTL
+    KEY_STATS_EVENTS,
+};
+
+// Load the counters from EEPROM.
+void key_stats_init(void);
+
+// Count a key press at the layout position (0-based) on the specified layer.
+void key_stats_record_press(uint8_t layer, uint8_t position);
+
+// Count a chatter event at the layout position (0-based).
+void key_stats_record_chatter(uint8_t position);
+
+// Count an event from `enum key_stats_events`.
+void key_stats_record_event(uint8_t event);
+
+// Write the changed counters to EEPROM periodically (when the keyboard is
+// idle).
+void key_stats_task(void);
+
+// Copy `size` bytes of the counter table starting from `offset` into `data`
+// (bytes outside of the table are set to 0).  The table contains the press
+// counters (layer-major), the chatter counters and the event counters.
+void key_stats_read(uint16_t offset, uint8_t *data, uint8_t size);
+
+// Reset all counters.
+void key_stats_reset(void);
@@ -3,6 +3,30 @@
 
 #include QMK_KEYBOARD_H
 
+#include "adaptive_debounce.h"
+#include "idle_power.h"
+#include "keymap_overrides.h"
+#include "macro_recorder.h"
+#include "user_settings.h"
+#ifdef EVENT_TRACE_ENABLE
+#    include "event_trace.h"
+#endif
+#ifdef LATENCY_STATS_ENABLE
+#    include "latency_stats.h"
+#endif
+#ifdef KEY_STATS_ENABLE
+#    include "key_stats.h"
+#endif
+#ifdef REPORT_BATCHING_ENABLE
+#    include "report_batching.h"
+#endif
+#ifdef MODS_FUZZ_ENABLE
+#    include "mods_fuzz.h"
+#endif
+#ifdef RAW_ENABLE
+#    include "raw_hid.h"
+#endif
+
 enum layer_names {
     _QWERTY,
     _NUMPAD,
@@ -11,32 +35,59 @@ enum layer_names {
     _ADJUST,
 };
 
+// The custom keycodes are stored in the keymap overrides, therefore existing
+// keycodes must not be renumbered: new keycodes must be added at the end
+// (CUSTOM_KEYCODES_VERSION must be incremented if the existing keycodes or
+// the tap dance indexes are changed anyway, so that the stored overrides are
+// discarded).
+#define CUSTOM_KEYCODES_VERSION 1
+
 enum custom_keycodes {
     U_LSW = QK_USER, // Language switch key (intended to be modified by Shift)
     U_LSWM0,         // Set language switch mode 0 (Caps Lock)
     U_LSWM1,         // Set language switch mode 1 (Ctrl+F15)
     U_LSFTL,         // Left Shift with language switch on double tap
     U_RSFTL,         // Right Shift with language switch on double tap
+    U_STATS,         // Type latency statistics (if enabled)
+    U_LSWM2,         // Set language switch mode 2 (Alt+Shift)
+    U_LSWM3,         // Set language switch mode 3 (Ctrl+Shift)
+    U_LSWM4,         // Set language switch mode 4 (GUI+Space)
+    U_TTDN,          // Decrease tapping term for the selected key
+    U_TTUP,          // Increase tapping term for the selected key
+    U_TTPRT,         // Type the selected key index and its tapping term
+    U_LSWS,          // Language switch key with Shift
+    U_RALTG,         // Right Alt with Right GUI on double tap, both on triple
+    U_MREC1,         // Record macro 1 (or stop recording)
+    U_MREC2,         // Record macro 2 (or stop recording)
+    U_MREC3,         // Record macro 3 (or stop recording)
+    U_MREC4,         // Record macro 4 (or stop recording)
+    U_MPLY1,         // Play macro 1
+    U_MPLY2,         // Play macro 2
+    U_MPLY3,         // Play macro 3
+    U_MPLY4,         // Play macro 4
+    U_MSTOP,         // Stop macro recording or playback
+    U_MRATE,         // Select the next macro playback rate
+    U_TTNXT,         // Select the next key for tapping term adjustment
+    U_MFUZZ,         // Start the modifier fuzzer (if enabled)
+    U_IDLE,          // Select the next idle timeout (see idle_power.c)
 };
 
 enum tap_dance_ids {
-    TD_RALT, // Right Alt combined with Right GUI
     TD_RCTL, // MO(_FN) combined with App on tap and Right Ctrl
     TD_LSFT, // Left Shift with language switch on double tap
     TD_RSFT, // Right Shift with language switch on double tap
 };
 
-typedef union {
-    uint32_t raw;
-    struct {
-        uint32_t lang_switch_mode : 1;
-    };
-} user_config_t;
-
-static user_config_t user_config;
+enum lang_switch_modes {
+    LSW_MODE_CAPS,
+    LSW_MODE_CTRL_F15,
+    LSW_MODE_ALT_SHIFT,
+    LSW_MODE_CTRL_SHIFT,
+    LSW_MODE_GUI_SPACE,
+    LSW_MODE_COUNT,
+};
 
 #define U_FESC LT(_FN, KC_ESC)
-#define U_TRALT TD(TD_RALT)
 #define U_TRCTL TD(TD_RCTL)
 #define U_NBSLS LT(_NUMPAD, KC_BSLS)
 #define U_MOADJ MO(_ADJUST)
@@ -49,7 +100,38 @@ static user_config_t user_config;
 #define U_TLSFT TD(TD_LSFT)
 #define U_TRSFT TD(TD_RSFT)
 
+// Layout positions (in the order of LAYOUT_65_ansi_blocker_tsangan_split_bs()
+// arguments) are used instead of matrix positions in the key statistics, the
+// keymap overrides and the raw HID protocol, so that those do not depend on
+// the matrix of a particular keyboard; `layout_positions[]` maps the matrix
+// positions to the layout positions.
+
 // clang-format off
+enum layout_positions {
+    LP_NONE,
+    LP_GRV, LP_1, LP_2, LP_3, LP_4, LP_5, LP_6, LP_7, LP_8, LP_9, LP_0, LP_MINS, LP_EQL, LP_BSLS, LP_INS, LP_DEL,
+    LP_TAB, LP_Q, LP_W, LP_E, LP_R, LP_T, LP_Y, LP_U, LP_I, LP_O, LP_P, LP_LBRC, LP_RBRC, LP_BSPC, LP_PGUP,
+    LP_ESC, LP_A, LP_S, LP_D, LP_F, LP_G, LP_H, LP_J, LP_K, LP_L, LP_SCLN, LP_QUOT, LP_ENT, LP_PGDN,
+    LP_LSFT, LP_Z, LP_X, LP_C, LP_V, LP_B, LP_N, LP_M, LP_COMM, LP_DOT, LP_SLSH, LP_RSFT, LP_UP, LP_RCTL,
+    LP_LCTL, LP_LGUI, LP_LALT, LP_SPC, LP_RALT, LP_LEFT, LP_DOWN, LP_RGHT,
+};
+
+static const uint8_t PROGMEM layout_positions[MATRIX_ROWS][MATRIX_COLS] = LAYOUT_65_ansi_blocker_tsangan_split_bs(
+    LP_GRV,  LP_1,    LP_2,    LP_3,    LP_4,    LP_5,    LP_6,    LP_7,    LP_8,    LP_9,    LP_0,    LP_MINS, LP_EQL,  LP_BSLS, LP_INS,  LP_DEL,
+    LP_TAB,      LP_Q,    LP_W,    LP_E,    LP_R,    LP_T,    LP_Y,    LP_U,    LP_I,    LP_O,    LP_P,    LP_LBRC, LP_RBRC, LP_BSPC,      LP_PGUP,
+    LP_ESC,        LP_A,    LP_S,    LP_D,    LP_F,    LP_G,    LP_H,    LP_J,    LP_K,    LP_L,    LP_SCLN, LP_QUOT, LP_ENT,              LP_PGDN,
+    LP_LSFT,            LP_Z,    LP_X,    LP_C,    LP_V,    LP_B,    LP_N,    LP_M,    LP_COMM, LP_DOT,  LP_SLSH, LP_RSFT,        LP_UP,   LP_RCTL,
+    LP_LCTL,     LP_LGUI, LP_LALT,                                 LP_SPC,                             LP_RALT,          LP_LEFT, LP_DOWN, LP_RGHT
+);
+
+// All layers are stored as full matrices, even though _NUMPAD and _FN_CTL are
+// mostly transparent (29 and 3 of 67 positions are not KC_TRNS).  Storing
+// those two layers as sparse (position, keycode) lists would save only about
+// 200 bytes of flash (_FN and _ADJUST are nearly full, so they would get
+// larger), but the lookup would become a search instead of indexing, and the
+// layers could not be edited or read by tools as LAYOUT() definitions.  The
+// layer lookup is not a bottleneck either, because its results are cached
+// (see `keycode_cache_keycode[]` below).
 const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     /*
      * ┌───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┐
@@ -61,7 +143,7 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
      * ├──────┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴────┬───┼───┤
      * │ ShiftL │ Z │ X │ C │ V │ B │ N │ M │ , │ . │ / │ShiftL│ ↑ │TRC│
      * ├─────┬──┴┬──┴──┬┴───┴───┴───┴───┴───┴───┴──┬┴───┴┬─┬───┼───┼───┤
-     * │Ctrl │GUI│Alt  │                           │TRAlt│ │ ← │ ↓ │ → │
+     * │Ctrl │GUI│Alt  │                           │RAltG│ │ ← │ ↓ │ → │
      * └─────┴───┴─────┴───────────────────────────┴─────┘ └───┴───┴───┘
      */
     [_QWERTY] = LAYOUT_65_ansi_blocker_tsangan_split_bs(
@@ -69,7 +151,7 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
         KC_TAB,      KC_Q,    KC_W,    KC_E,    KC_R,    KC_T,    KC_Y,    KC_U,    KC_I,    KC_O,    KC_P,    KC_LBRC, KC_RBRC, KC_BSPC,      KC_PGUP,
         U_FESC,        KC_A,    KC_S,    KC_D,    KC_F,    KC_G,    KC_H,    KC_J,    KC_K,    KC_L,    KC_SCLN, KC_QUOT, KC_ENT,              KC_PGDN,
         U_TLSFT,            KC_Z,    KC_X,    KC_C,    KC_V,    KC_B,    KC_N,    KC_M,    KC_COMM, KC_DOT,  KC_SLSH, U_TRSFT,        KC_UP,   U_TRCTL,
-        KC_LCTL,     KC_LGUI, KC_LALT,                                 KC_SPC,                             U_TRALT,          KC_LEFT, KC_DOWN, KC_RGHT
+        KC_LCTL,     KC_LGUI, KC_LALT,                                 KC_SPC,                             U_RALTG,          KC_LEFT, KC_DOWN, KC_RGHT
     ),
 
     /*
@@ -97,9 +179,9 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
      * ┌───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┐
      * │ ` │F1 │F2 │F3 │F4 │F5 │F6 │F7 │F8 │F9 │F10│F11│F12│TgN│Hom│End│
      * ├───┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴───┼───┤
-     * │LngSw│MB1│Ms↑│MB2│Wh↑│DM1│Ins│Hom│ ↑ │End│PgU│V+ │Mut│ Del │CPU│
+     * │LngSw│MB1│Ms↑│MB2│Wh↑│MP1│Ins│Hom│ ↑ │End│PgU│V+ │Mut│ Del │CPU│
      * ├─────┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴─────┼───┤
-     * │Caps  │Ms←│Ms↓│Ms→│Wh↓│DM2│Del│ ← │ ↓ │ → │PgD│V- │ PEnter │CPD│
+     * │Caps  │Ms←│Ms↓│Ms→│Wh↓│MP2│Del│ ← │ ↓ │ → │PgD│V- │ PEnter │CPD│
      * ├──────┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴────┬───┼───┤
      * │        │MB3│MB4│MB5│Wh←│Wh→│PSc│ScL│Pau│ORG│ORC│      │PgU│   │
      * ├─────┬──┴┬──┴──┬┴───┴───┴───┴───┴───┴───┴──┬┴───┴┬─┬───┼───┼───┤
@@ -108,19 +190,19 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
      */
     [_FN] = LAYOUT_65_ansi_blocker_tsangan_split_bs(
         _______, KC_F1,   KC_F2,   KC_F3,   KC_F4,   KC_F5,   KC_F6,   KC_F7,   KC_F8,   KC_F9,   KC_F10,  KC_F11,  KC_F12,  U_TGNUM, KC_HOME, KC_END,
-        U_LSW,       KC_BTN1, KC_MS_U, KC_BTN2, KC_WH_U, DM_PLY1, KC_INS,  KC_HOME, KC_UP,   KC_END,  KC_PGUP, KC_VOLU, KC_MUTE, KC_DEL,       U_CPGUP,
-        KC_CAPS,       KC_MS_L, KC_MS_D, KC_MS_R, KC_WH_D, DM_PLY2, KC_DEL,  KC_LEFT, KC_DOWN, KC_RGHT, KC_PGDN, KC_VOLD, KC_PENT,             U_CPGDN,
+        U_LSW,       KC_BTN1, KC_MS_U, KC_BTN2, KC_WH_U, U_MPLY1, KC_INS,  KC_HOME, KC_UP,   KC_END,  KC_PGUP, KC_VOLU, KC_MUTE, KC_DEL,       U_CPGUP,
+        KC_CAPS,       KC_MS_L, KC_MS_D, KC_MS_R, KC_WH_D, U_MPLY2, KC_DEL,  KC_LEFT, KC_DOWN, KC_RGHT, KC_PGDN, KC_VOLD, KC_PENT,             U_CPGDN,
         _______,            KC_BTN3, KC_BTN4, KC_BTN5, KC_WH_L, KC_WH_R, KC_PSCR, KC_SCRL, KC_PAUS, U_OSRGU, U_OSRCT, _______,        KC_PGUP, _______,
         U_FNCTL,     _______, _______,                                 U_MOADJ,                            _______,          KC_HOME, KC_PGDN, KC_END
     ),
 
     /*
      * ┌───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┐
-     * │DRS│   │   │   │   │   │   │   │   │   │   │   │   │   │   │   │
+     * │MSt│   │   │   │   │   │   │   │   │   │   │   │   │   │   │   │
      * ├───┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴───┼───┤
-     * │     │   │   │   │   │DR1│   │   │   │   │   │   │   │     │   │
+     * │     │   │   │   │   │MR1│   │   │   │   │   │   │   │     │   │
      * ├─────┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴─────┼───┤
-     * │      │   │   │   │   │DR2│   │   │   │   │   │   │        │   │
+     * │      │   │   │   │   │MR2│   │   │   │   │   │   │        │   │
      * ├──────┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴────┬───┼───┤
      * │        │   │   │   │   │   │   │   │   │   │   │      │   │   │
      * ├─────┬──┴┬──┴──┬┴───┴───┴───┴───┴───┴───┴──┬┴───┴┬─┬───┼───┼───┤
@@ -128,31 +210,31 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
      * └─────┴───┴─────┴───────────────────────────┴─────┘ └───┴───┴───┘
      */
     [_FN_CTL] = LAYOUT_65_ansi_blocker_tsangan_split_bs(
-        DM_RSTP, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______,
-        _______,     _______, _______, _______, _______, DM_REC1, _______, _______, _______, _______, _______, _______, _______, _______,      _______,
-        _______,       _______, _______, _______, _______, DM_REC2, _______, _______, _______, _______, _______, _______, _______,             _______,
+        U_MSTOP, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______,
+        _______,     _______, _______, _______, _______, U_MREC1, _______, _______, _______, _______, _______, _______, _______, _______,      _______,
+        _______,       _______, _______, _______, _______, U_MREC2, _______, _______, _______, _______, _______, _______, _______,             _______,
         _______,            _______, _______, _______, _______, _______, _______, _______, _______, _______, _______, _______,        _______, _______,
         _______,     _______, _______,                                 _______,                            _______,          _______, _______, _______
     ),
 
     /*
      * ┌───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┬───┐
-     * │BLd│LS0│LS1│   │   │   │   │   │   │   │   │NKT│Dbg│   │   │Rst│
+     * │BLd│LS0│LS1│LS2│LS3│LS4│Idl│   │   │   │   │NKT│Dbg│Sta│MFz│Rst│
      * ├───┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴───┼───┤
-     * │     │BTg│BL-│BL+│BBr│   │   │   │   │   │   │NK-│NK+│EEClr│   │
+     * │     │BTg│BL-│BL+│BBr│   │Tm-│Tm+│TmP│TmN│   │NK-│NK+│EEClr│   │
      * ├─────┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴┬──┴─────┼───┤
-     * │      │RTg│RM+│Hu+│Sa+│Va+│Sp+│   │   │   │   │   │        │   │
+     * │      │RTg│RM+│Hu+│Sa+│Va+│Sp+│   │MP3│MP4│MRt│   │        │   │
      * ├──────┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴─┬─┴────┬───┼───┤
-     * │        │RMP│RM-│Hu-│Sa-│Va-│Sp-│   │   │   │   │      │   │   │
+     * │        │RMP│RM-│Hu-│Sa-│Va-│Sp-│MR3│MR4│   │   │      │   │   │
      * ├─────┬──┴┬──┴──┬┴───┴───┴───┴───┴───┴───┴──┬┴───┴┬─┬───┼───┼───┤
      * │     │   │     │                           │     │ │   │   │   │
      * └─────┴───┴─────┴───────────────────────────┴─────┘ └───┴───┴───┘
      */
     [_ADJUST] = LAYOUT_65_ansi_blocker_tsangan_split_bs(
-        QK_BOOT, U_LSWM0, U_LSWM1, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, NK_TOGG, DB_TOGG, XXXXXXX, XXXXXXX, QK_RBT,
-        XXXXXXX,     BL_TOGG, BL_DOWN, BL_UP,   BL_BRTG, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, NK_OFF,  NK_ON,   EE_CLR,       XXXXXXX,
-        _______,       RGB_TOG, RGB_MOD, RGB_HUI, RGB_SAI, RGB_VAI, RGB_SPI, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX,             XXXXXXX,
-        _______,            RGB_M_P, RGB_RMOD,RGB_HUD, RGB_SAD, RGB_VAD, RGB_SPD, XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, _______,        XXXXXXX, _______,
+        QK_BOOT, U_LSWM0, U_LSWM1, U_LSWM2, U_LSWM3, U_LSWM4, U_IDLE,  XXXXXXX, XXXXXXX, XXXXXXX, XXXXXXX, NK_TOGG, DB_TOGG, U_STATS, U_MFUZZ, QK_RBT,
+        XXXXXXX,     BL_TOGG, BL_DOWN, BL_UP,   BL_BRTG, XXXXXXX, U_TTDN,  U_TTUP,  U_TTPRT, U_TTNXT, XXXXXXX, NK_OFF,  NK_ON,   EE_CLR,       XXXXXXX,
+        _______,       RGB_TOG, RGB_MOD, RGB_HUI, RGB_SAI, RGB_VAI, RGB_SPI, XXXXXXX, U_MPLY3, U_MPLY4, U_MRATE, XXXXXXX, XXXXXXX,             XXXXXXX,
+        _______,            RGB_M_P, RGB_RMOD,RGB_HUD, RGB_SAD, RGB_VAD, RGB_SPD, U_MREC3, U_MREC4, XXXXXXX, XXXXXXX, _______,        XXXXXXX, _______,
         _______,     _______, _______,                                 _______,                            _______,          XXXXXXX, XXXXXXX, XXXXXXX
     ),
 
@@ -168,6 +250,154 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
 };
 // clang-format on
 
+static uint8_t get_layout_position(keypos_t key) {
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) {
+        return LP_NONE;
+    }
+    return pgm_read_byte(&layout_positions[key.row][key.col]);
+}
+
+static uint16_t get_layer_keycode(uint8_t layer, keypos_t key) {
+    if (layer >= ARRAY_SIZE(keymaps)) {
+        return KC_TRNS;
+    }
+
+    uint8_t  position = get_layout_position(key);
+    uint16_t keycode;
+    if (position != LP_NONE && keymap_override_get(layer, position, &keycode)) {
+        return keycode;
+    }
+    return pgm_read_word(&keymaps[layer][key.row][key.col]);
+}
+
+// Keycode cache: the effective layer (the highest active layer which is not
+// transparent) and the keycode on that layer for every matrix position under
+// the current layer state.  The QMK layer lookup walks the active layers from
+// the top calling `keymap_key_to_keycode()` for each one; with the cache, each
+// of those calls is a single array read.  Entries are filled on the first
+// lookup for a position, and the whole cache is invalidated whenever the layer
+// state or the default layer state changes.
+static uint8_t  keycode_cache_layer[MATRIX_ROWS][MATRIX_COLS]; // effective layer + 1 (0 if not valid)
+static uint16_t keycode_cache_keycode[MATRIX_ROWS][MATRIX_COLS];
+
+static void keycode_cache_invalidate(void) {
+    memset(keycode_cache_layer, 0, sizeof(keycode_cache_layer));
+}
+
+uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key) {
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) {
+        return KC_NO;
+    }
+
+    layer_state_t layers = layer_state | default_layer_state;
+    if (keycode_cache_layer[key.row][key.col] == 0) {
+        uint8_t top = 0;
+        for (uint8_t i = ARRAY_SIZE(keymaps); i-- > 0;) {
+            if ((layers & ((layer_state_t)1 << i)) && get_layer_keycode(i, key) != KC_TRNS) {
+                top = i;
+                break;
+            }
+        }
+        keycode_cache_layer[key.row][key.col]   = top + 1;
+        keycode_cache_keycode[key.row][key.col] = get_layer_keycode(top, key);
+    }
+
+    uint8_t effective_layer = keycode_cache_layer[key.row][key.col] - 1;
+
+    if (layer == effective_layer) {
+        return keycode_cache_keycode[key.row][key.col];
+    }
+    if (layer > effective_layer && (layers & ((layer_state_t)1 << layer))) {
+        // Active layers above the effective layer are transparent.
+        return KC_TRNS;
+    }
+    return get_layer_keycode(layer, key);
+}
+
+#ifdef RGBLIGHT_LAYERS
+// Indicators for the active layers and the language switch mode (the mode is
+// shown only on the _ADJUST layer, where it can be changed: the LED with the
+// number of the selected mode is lit).  All frames are constant segment lists
+// in PROGMEM; they are switched only when the layer state or the language
+// switch mode changes, therefore the indicators do not add any work to the
+// matrix scan loop.
+#    ifndef RGBLIGHT_INDICATOR_LEDS
+#        define RGBLIGHT_INDICATOR_LEDS 4
+#    endif
+
+enum rgb_layer_indexes {
+    RGB_LAYER_NUMPAD,
+    RGB_LAYER_FN,
+    RGB_LAYER_FN_CTL,
+    RGB_LAYER_ADJUST,
+    RGB_LAYER_LSW_MODE0,
+};
+
+static const rgblight_segment_t PROGMEM rgb_layer_numpad[] = RGBLIGHT_LAYER_SEGMENTS({0, RGBLIGHT_INDICATOR_LEDS, HSV_GREEN});
+static const rgblight_segment_t PROGMEM rgb_layer_fn[]     = RGBLIGHT_LAYER_SEGMENTS({0, RGBLIGHT_INDICATOR_LEDS, HSV_BLUE});
+static const rgblight_segment_t PROGMEM rgb_layer_fn_ctl[] = RGBLIGHT_LAYER_SEGMENTS({0, RGBLIGHT_INDICATOR_LEDS, HSV_PURPLE});
+static const rgblight_segment_t PROGMEM rgb_layer_adjust[] = RGBLIGHT_LAYER_SEGMENTS({0, RGBLIGHT_INDICATOR_LEDS, HSV_RED});
+static const rgblight_segment_t PROGMEM rgb_lsw_mode0[]    = RGBLIGHT_LAYER_SEGMENTS({0, 1, HSV_WHITE});
+static const rgblight_segment_t PROGMEM rgb_lsw_mode1[]    = RGBLIGHT_LAYER_SEGMENTS({1, 1, HSV_WHITE});
+static const rgblight_segment_t PROGMEM rgb_lsw_mode2[]    = RGBLIGHT_LAYER_SEGMENTS({2, 1, HSV_WHITE});
+static const rgblight_segment_t PROGMEM rgb_lsw_mode3[]    = RGBLIGHT_LAYER_SEGMENTS({3, 1, HSV_WHITE});
+static const rgblight_segment_t PROGMEM rgb_lsw_mode4[]    = RGBLIGHT_LAYER_SEGMENTS({4, 1, HSV_WHITE});
+
+// Later entries take priority over the earlier ones.
+static const rgblight_segment_t *const PROGMEM rgb_layers[] = RGBLIGHT_LAYERS_LIST(
+    [RGB_LAYER_NUMPAD]        = rgb_layer_numpad,
+    [RGB_LAYER_FN]            = rgb_layer_fn,
+    [RGB_LAYER_FN_CTL]        = rgb_layer_fn_ctl,
+    [RGB_LAYER_ADJUST]        = rgb_layer_adjust,
+    [RGB_LAYER_LSW_MODE0 + 0] = rgb_lsw_mode0,
+    [RGB_LAYER_LSW_MODE0 + 1] = rgb_lsw_mode1,
+    [RGB_LAYER_LSW_MODE0 + 2] = rgb_lsw_mode2,
+    [RGB_LAYER_LSW_MODE0 + 3] = rgb_lsw_mode3,
+    [RGB_LAYER_LSW_MODE0 + 4] = rgb_lsw_mode4
+);
+
+_Static_assert(ARRAY_SIZE(rgb_layers) - 1 <= RGBLIGHT_MAX_LAYERS, "RGBLIGHT_MAX_LAYERS is too small");
+
+// Older QMK versions use RGBLED_NUM for the number of LEDs.
+#    if !defined(RGBLIGHT_LED_COUNT) && defined(RGBLED_NUM)
+#        define RGBLIGHT_LED_COUNT RGBLED_NUM
+#    endif
+
+_Static_assert(RGBLIGHT_INDICATOR_LEDS <= RGBLIGHT_LED_COUNT, "RGBLIGHT_INDICATOR_LEDS is larger than the number of LEDs");
+_Static_assert(LSW_MODE_COUNT <= RGBLIGHT_LED_COUNT, "Not enough LEDs for the language switch mode indicators");
+#endif
+
+static void update_indicators(layer_state_t state) {
+#ifdef RGBLIGHT_LAYERS
+    // RGBLIGHT_LAYERS_OVERRIDE_RGB_OFF would keep the indicators on while the
+    // lighting is suspended, therefore they are turned off explicitly.
+    if (idle_power_is_idle()) {
+        state = 0;
+    }
+
+    bool adjust = layer_state_cmp(state, _ADJUST);
+
+    rgblight_set_layer_state(RGB_LAYER_NUMPAD, layer_state_cmp(state, _NUMPAD));
+    rgblight_set_layer_state(RGB_LAYER_FN, layer_state_cmp(state, _FN));
+    rgblight_set_layer_state(RGB_LAYER_FN_CTL, layer_state_cmp(state, _FN_CTL));
+    rgblight_set_layer_state(RGB_LAYER_ADJUST, adjust);
+    for (uint8_t mode = LSW_MODE_CAPS; mode < LSW_MODE_COUNT; ++mode) {
+        rgblight_set_layer_state(RGB_LAYER_LSW_MODE0 + mode, adjust && user_config.lang_switch_mode == mode);
+    }
+#endif
+}
+
+layer_state_t layer_state_set_user(layer_state_t state) {
+    keycode_cache_invalidate();
+    update_indicators(state);
+    return state;
+}
+
+layer_state_t default_layer_state_set_user(layer_state_t state) {
+    keycode_cache_invalidate();
+    return state;
+}
+
 bool get_hold_on_other_key_press(uint16_t keycode, keyrecord_t *record) {
     switch (keycode) {
         case U_FESC:
@@ -178,146 +408,230 @@ bool get_hold_on_other_key_press(uint16_t keycode, keyrecord_t *record) {
     }
 }
 
-// Tap dance for the “Right Alt” key:
-// - hold: KC_RALT
-// - tap: KC_RALT
-// - tap and hold: KC_RGUI
-// - double tap: KC_RGUI
-// - double tap and hold: KC_RGUI+KC_RALT
-// - triple tap: KC_RGUI+KC_RALT
-enum td_ralt_state {
-    TD_RALT_NOOP,
-    TD_RALT_RALT,
-    TD_RALT_RGUI,
-    TD_RALT_RGUI_RALT,
+// Keys with tapping terms which can be adjusted at runtime; the tapping terms
+// are stored in `user_config.tapping_term[]` in the same order (0 means that
+// the default TAPPING_TERM is used).
+static const uint16_t PROGMEM tapping_term_keycodes[] = {
+    U_RALTG,
+    U_TRCTL,
+    U_TLSFT,
+    U_TRSFT,
+    U_LSFTL,
+    U_RSFTL,
 };
 
-static enum td_ralt_state td_ralt_state;
+_Static_assert(ARRAY_SIZE(tapping_term_keycodes) == TAPPING_TERM_KEY_COUNT, "Mismatched tapping_term_keycodes and TAPPING_TERM_KEY_COUNT");
 
-static void td_ralt_finished(tap_dance_state_t *state, void *user_data) {
-    switch (state->count) {
-        case 1:
-            td_ralt_state = TD_RALT_RALT;
-            break;
-        case 2:
-            td_ralt_state = TD_RALT_RGUI;
-            break;
-        case 3:
-            td_ralt_state = TD_RALT_RGUI_RALT;
-            break;
-        default:
-            td_ralt_state = TD_RALT_NOOP;
-            break;
+#define TAPPING_TERM_MIN 50
+#define TAPPING_TERM_MAX 1000
+#define TAPPING_TERM_STEP 10
+
+// Index of the key whose tapping term is adjusted by U_TTDN/U_TTUP (selected
+// explicitly by U_TTNXT).
+static uint8_t tapping_term_index;
+
+static int8_t get_tapping_term_index(uint16_t keycode) {
+    for (uint8_t i = 0; i < ARRAY_SIZE(tapping_term_keycodes); ++i) {
+        if (pgm_read_word(&tapping_term_keycodes[i]) == keycode) {
+            return i;
+        }
     }
+    return -1;
+}
 
-    switch (td_ralt_state) {
-        case TD_RALT_NOOP:
-            break;
-        case TD_RALT_RALT:
-            register_code(KC_RALT);
-            break;
-        case TD_RALT_RGUI:
-            register_code(KC_RGUI);
-            break;
-        case TD_RALT_RGUI_RALT:
-            register_code(KC_RGUI);
-            register_code(KC_RALT);
-            break;
+uint16_t get_tapping_term(uint16_t keycode, keyrecord_t *record) {
+    int8_t index = get_tapping_term_index(keycode);
+    if (index >= 0 && user_config.tapping_term[index] != 0) {
+        return user_config.tapping_term[index];
     }
+    return TAPPING_TERM;
 }
 
-static void td_ralt_reset(tap_dance_state_t *state, void *user_data) {
-    switch (td_ralt_state) {
-        case TD_RALT_NOOP:
-            break;
-        case TD_RALT_RALT:
-            unregister_code(KC_RALT);
-            break;
-        case TD_RALT_RGUI:
-            unregister_code(KC_RGUI);
-            break;
-        case TD_RALT_RGUI_RALT:
-            unregister_code(KC_RALT);
-            unregister_code(KC_RGUI);
-            break;
+static void adjust_tapping_term(int16_t delta) {
+    uint16_t keycode = pgm_read_word(&tapping_term_keycodes[tapping_term_index]);
+    int16_t  term    = get_tapping_term(keycode, NULL) + delta;
+
+    if (term < TAPPING_TERM_MIN) {
+        term = TAPPING_TERM_MIN;
+    } else if (term > TAPPING_TERM_MAX) {
+        term = TAPPING_TERM_MAX;
     }
+    user_config.tapping_term[tapping_term_index] = term;
+    user_settings_save();
+}
+
+static void send_tapping_term(void) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "%u:%u", tapping_term_index, get_tapping_term(pgm_read_word(&tapping_term_keycodes[tapping_term_index]), NULL));
+    send_string(buf);
 }
 
 // Tap dance for the “Right Ctrl” key:
-// - hold: MO(_FN)
+// - hold: MO(_FN) (also activated immediately when another key is pressed)
 // - tap: KC_APP
-// - tap and hold: KC_RCTL
+// - tap and hold: KC_RCTL (also activated immediately by another key press)
 // - double tap: KC_RCTL
 // - double tap and hold: KC_APP
 // - triple tap: KC_APP
+// The keycodes for every state may be overridden at runtime (the override
+// index is the state number).
 enum td_rctl_state {
+    TD_RCTL_HOLD,
+    TD_RCTL_TAP,
+    TD_RCTL_DOUBLE,
+    TD_RCTL_TRIPLE,
     TD_RCTL_NOOP,
-    TD_RCTL_MO_FN,
-    TD_RCTL_APP,
-    TD_RCTL_RCTL,
 };
 
-static enum td_rctl_state td_rctl_state;
+static const uint16_t PROGMEM td_rctl_keycodes[] = {
+    [TD_RCTL_HOLD]   = MO(_FN),
+    [TD_RCTL_TAP]    = KC_APP,
+    [TD_RCTL_DOUBLE] = KC_RCTL,
+    [TD_RCTL_TRIPLE] = KC_APP,
+};
+
+#ifdef KEY_STATS_ENABLE
+_Static_assert(ARRAY_SIZE(td_rctl_keycodes) == KEY_STATS_RALTG - KEY_STATS_TD_RCTL, "Mismatched td_rctl_keycodes and KEY_STATS_TD_RCTL sizes");
+#endif
+
+static uint8_t td_rctl_state = TD_RCTL_NOOP; // enum td_rctl_state
+
+static uint16_t td_rctl_keycode(enum td_rctl_state state) {
+    uint16_t keycode;
+    if (keymap_override_get(KEYMAP_OVERRIDE_TAP_DANCE | TD_RCTL, state, &keycode)) {
+        return keycode;
+    }
+    return pgm_read_word(&td_rctl_keycodes[state]);
+}
 
 static void td_rctl_finished(tap_dance_state_t *state, void *user_data) {
     switch (state->count) {
         case 1:
-            if (state->pressed) {
-                td_rctl_state = TD_RCTL_MO_FN;
-            } else {
-                td_rctl_state = TD_RCTL_APP;
-            };
+            td_rctl_state = state->pressed ? TD_RCTL_HOLD : TD_RCTL_TAP;
             break;
         case 2:
-            td_rctl_state = TD_RCTL_RCTL;
+            td_rctl_state = TD_RCTL_DOUBLE;
             break;
         case 3:
-            td_rctl_state = TD_RCTL_APP;
+            td_rctl_state = TD_RCTL_TRIPLE;
             break;
         default:
             td_rctl_state = TD_RCTL_NOOP;
-            break;
+            return;
     }
+#ifdef KEY_STATS_ENABLE
+    key_stats_record_event(KEY_STATS_TD_RCTL + td_rctl_state);
+#endif
 
-    switch (td_rctl_state) {
-        case TD_RCTL_NOOP:
-            break;
-        case TD_RCTL_MO_FN:
-            layer_on(_FN);
-            break;
-        case TD_RCTL_APP:
-            register_code(KC_APP);
-            break;
-        case TD_RCTL_RCTL:
-            register_code(KC_RCTL);
-            break;
+    uint16_t keycode = td_rctl_keycode(td_rctl_state);
+    if (IS_QK_MOMENTARY(keycode)) {
+        layer_on(QK_MOMENTARY_GET_LAYER(keycode));
+    } else {
+        register_code16(keycode);
     }
 }
 
 static void td_rctl_reset(tap_dance_state_t *state, void *user_data) {
-    switch (td_rctl_state) {
-        case TD_RCTL_NOOP:
-            break;
-        case TD_RCTL_MO_FN:
-            layer_off(_FN);
-            break;
-        case TD_RCTL_APP:
-            unregister_code(KC_APP);
-            break;
-        case TD_RCTL_RCTL:
-            unregister_code(KC_RCTL);
-            break;
+    if (td_rctl_state == TD_RCTL_NOOP) {
+        return;
+    }
+
+    uint16_t keycode = td_rctl_keycode(td_rctl_state);
+    if (IS_QK_MOMENTARY(keycode)) {
+        layer_off(QK_MOMENTARY_GET_LAYER(keycode));
+    } else {
+        unregister_code16(keycode);
     }
+    td_rctl_state = TD_RCTL_NOOP;
 }
 
-static uint16_t get_lsw_keycode(void) {
+// Get the language switch chord: the modifiers (in the 8-bit format, always
+// the left side ones) and the base keycode (KC_NO if the chord consists only
+// of modifiers).  The chord is not stored as a modified keycode, because
+// combining the 5-bit modifier values in keycodes (e.g., RSFT(A(KC_LSFT)))
+// turns all modifiers into the right side ones, and Right Alt is AltGr on
+// many layouts.
+static uint8_t get_lsw_chord(uint8_t *mods) {
     switch (user_config.lang_switch_mode) {
-        case 0:
+        case LSW_MODE_CAPS:
         default:
+            *mods = 0;
             return KC_CAPS;
 
-        case 1:
-            return C(KC_F15);
+        case LSW_MODE_CTRL_F15:
+            *mods = MOD_BIT(KC_LCTL);
+            return KC_F15;
+
+        case LSW_MODE_ALT_SHIFT:
+            *mods = MOD_BIT(KC_LALT) | MOD_BIT(KC_LSFT);
+            return KC_NO;
+
+        case LSW_MODE_CTRL_SHIFT:
+            *mods = MOD_BIT(KC_LCTL) | MOD_BIT(KC_LSFT);
+            return KC_NO;
+
+        case LSW_MODE_GUI_SPACE:
+            *mods = MOD_BIT(KC_LGUI);
+            return KC_SPC;
+    }
+}
+
+// Press or release the language switch chord with the additional modifiers
+// (e.g., Shift to switch in the other direction) using a single HID report.
+// Using `register_code16()` for this would send separate reports for the
+// modifiers and the key, and some hosts may miss the language switch if those
+// reports are processed out of order.  The modifiers are sent as weak
+// modifiers, so that the physical modifier state is not affected.
+static void send_lsw_chord(uint8_t extra_mods, bool pressed) {
+    uint8_t mods;
+    uint8_t key = get_lsw_chord(&mods);
+
+    mods |= extra_mods;
+    if (pressed) {
+        add_weak_mods(mods);
+        if (key != KC_NO) {
+            add_key(key);
+        }
+    } else {
+        if (key != KC_NO) {
+            del_key(key);
+        }
+        del_weak_mods(mods);
+    }
+    send_keyboard_report();
+}
+
+// Caps Lock is held for TAP_HOLD_CAPS_DELAY like in `tap_code()`, because
+// some hosts (e.g., macOS) ignore shorter Caps Lock presses.
+static void tap_lsw_chord(uint8_t extra_mods) {
+    uint8_t mods;
+    uint8_t key = get_lsw_chord(&mods);
+
+    send_lsw_chord(extra_mods, true);
+#ifdef REPORT_BATCHING_ENABLE
+    report_batching_flush();
+#endif
+    wait_ms(key == KC_CAPS ? TAP_HOLD_CAPS_DELAY : TAP_CODE_DELAY);
+    send_lsw_chord(extra_mods, false);
+}
+
+// Presses of other keys while a Shift tap dance key is held (tracked in
+// pre_process_record_user(), before any buffering in the QMK core) for
+// U_TLSFT and U_TRSFT.  A press of a tap-hold key (e.g., U_FESC) stays in the
+// tapping buffer until the key is resolved, so it may interrupt the Shift tap
+// dance only after its last tap (or even after the next press of the same
+// Shift key); the double tap is not clean if any other key was pressed during
+// any of its taps.  The flag is cleared when the tap dance is reset.
+static bool lang_shift_held[2];
+static bool lang_shift_interrupted[2];
+
+static void lang_shift_pre_process(uint16_t keycode, keyrecord_t *record) {
+    for (uint8_t i = 0; i < ARRAY_SIZE(lang_shift_held); ++i) {
+        if (keycode == (i ? U_TRSFT : U_TLSFT)) {
+            lang_shift_held[i] = record->event.pressed;
+        } else if (record->event.pressed && lang_shift_held[i]) {
+            lang_shift_interrupted[i] = true;
+        }
     }
 }
 
@@ -329,171 +643,343 @@ static void td_lang_shift_on_each_tap(tap_dance_state_t *state, void *user_data)
     state->oneshot_mods = 0;
 }
 
-static void td_lang_shift_finished(tap_dance_state_t *state, uint16_t lsw_keycode) {
-    // If this was a clean double tap, send the language switch keycode.
-    if (state->count == 2 && !state->pressed) {
-        tap_code16(lsw_keycode);
+static void td_lang_shift_finished(tap_dance_state_t *state, bool right, uint8_t extra_mods) {
+    // If this was a clean double tap, send the language switch chord.
+    if (state->count == 2 && !state->pressed && !lang_shift_interrupted[right]) {
+        tap_lsw_chord(extra_mods);
+#ifdef KEY_STATS_ENABLE
+        key_stats_record_event(KEY_STATS_LSW_SHIFT_TAP_DANCE);
+#endif
     }
 }
 
 static void td_lsft_finished(tap_dance_state_t *state, void *user_data) {
-    td_lang_shift_finished(state, get_lsw_keycode());
+    td_lang_shift_finished(state, false, 0);
 }
 
 static void td_rsft_finished(tap_dance_state_t *state, void *user_data) {
-    td_lang_shift_finished(state, RSFT(get_lsw_keycode()));
+    td_lang_shift_finished(state, true, MOD_BIT(KC_RSFT));
+}
+
+static void td_lsft_reset(tap_dance_state_t *state, void *user_data) {
+    lang_shift_interrupted[0] = false;
+}
+
+static void td_rsft_reset(tap_dance_state_t *state, void *user_data) {
+    lang_shift_interrupted[1] = false;
 }
 
 tap_dance_action_t tap_dance_actions[] = {
-    [TD_RALT] = ACTION_TAP_DANCE_FN_ADVANCED(NULL, td_ralt_finished, td_ralt_reset),
     [TD_RCTL] = ACTION_TAP_DANCE_FN_ADVANCED(NULL, td_rctl_finished, td_rctl_reset),
-    [TD_LSFT] = ACTION_TAP_DANCE_FN_ADVANCED(td_lang_shift_on_each_tap, td_lsft_finished, NULL),
-    [TD_RSFT] = ACTION_TAP_DANCE_FN_ADVANCED(td_lang_shift_on_each_tap, td_rsft_finished, NULL),
+    [TD_LSFT] = ACTION_TAP_DANCE_FN_ADVANCED(td_lang_shift_on_each_tap, td_lsft_finished, td_lsft_reset),
+    [TD_RSFT] = ACTION_TAP_DANCE_FN_ADVANCED(td_lang_shift_on_each_tap, td_rsft_finished, td_rsft_reset),
+};
+
+// Combos for the actions which otherwise need a trip through several layers
+// or a held layer key.  The combo engine delays every key which is a part of
+// some combo until the combo term expires or another key is pressed, therefore
+// all combos start with the rarely typed Ins key and must be pressed in order
+// (COMBO_MUST_PRESS_IN_ORDER_PER_COMBO): the other combo keys are not delayed
+// unless Ins is already held, and Ins itself is delayed by the longest combo
+// term (CB_BOOT).  The combo keys are taken from the base layer
+// (COMBO_ONLY_FROM_LAYER), so that the combos do not depend on the layer
+// state.
+//
+// The combo engine checks every combo for every key event; with five two-key
+// combos that scan is cheaper than maintaining a per-key index, so no index
+// is kept here.
+enum combo_ids {
+    CB_CPGUP, // Ins + PgUp: Ctrl+PgUp
+    CB_CPGDN, // Ins + PgDn: Ctrl+PgDn
+    CB_LSWM0, // Ins + 1: language switch mode 0 (Caps Lock)
+    CB_LSWM1, // Ins + 2: language switch mode 1 (Ctrl+F15)
+    CB_BOOT,  // Ins + Del (must be held for COMBO_HOLD_TERM): bootloader
+};
+
+const uint16_t PROGMEM combo_cpgup[] = {KC_INS, KC_PGUP, COMBO_END};
+const uint16_t PROGMEM combo_cpgdn[] = {KC_INS, KC_PGDN, COMBO_END};
+const uint16_t PROGMEM combo_lswm0[] = {KC_INS, KC_1, COMBO_END};
+const uint16_t PROGMEM combo_lswm1[] = {KC_INS, KC_2, COMBO_END};
+const uint16_t PROGMEM combo_boot[]  = {KC_INS, KC_DEL, COMBO_END};
+
+combo_t key_combos[] = {
+    [CB_CPGUP] = COMBO(combo_cpgup, U_CPGUP),
+    [CB_CPGDN] = COMBO(combo_cpgdn, U_CPGDN),
+    [CB_LSWM0] = COMBO(combo_lswm0, U_LSWM0),
+    [CB_LSWM1] = COMBO(combo_lswm1, U_LSWM1),
+    [CB_BOOT]  = COMBO(combo_boot, QK_BOOT),
 };
 
+uint16_t get_combo_term(uint16_t index, combo_t *combo) {
+    // The bootloader combo is pressed deliberately and then held, so a slower
+    // press is allowed; accidental jumps are prevented by the hold requirement.
+    return index == CB_BOOT ? COMBO_TERM * 2 : COMBO_TERM;
+}
+
+bool get_combo_must_hold(uint16_t index, combo_t *combo) {
+    return index == CB_BOOT;
+}
+
+bool get_combo_must_press_in_order(uint16_t index, combo_t *combo) {
+    return true;
+}
+
 void keyboard_post_init_user(void) {
-    user_config.raw = eeconfig_read_user();
+    user_settings_init();
+    keymap_overrides_init(CUSTOM_KEYCODES_VERSION);
+#ifdef RGBLIGHT_LAYERS
+    rgblight_layers = rgb_layers;
+#endif
+#ifdef KEY_STATS_ENABLE
+    key_stats_init();
+#endif
 }
 
-enum td_mod_lsw_state {
-    TD_MOD_LSW_NOOP,
-    TD_MOD_LSW_MOD,
-    TD_MOD_LSW_LSW,
-};
+void housekeeping_task_user(void) {
+    user_settings_task();
+    keymap_overrides_task();
+    macro_task();
+#ifdef MODS_FUZZ_ENABLE
+    mods_fuzz_task();
+#endif
+#ifdef CONSOLE_ENABLE
+    event_trace_task();
+#endif
+#ifdef LATENCY_STATS_ENABLE
+    latency_stats_task();
+#endif
+#ifdef KEY_STATS_ENABLE
+    key_stats_task();
+#endif
+#ifdef REPORT_BATCHING_ENABLE
+    // Must be after all tasks which may send reports.
+    report_batching_task();
+#endif
+    // Must be the last call (sleeps while the keyboard is idle).
+    if (idle_power_task()) {
+        update_indicators(layer_state);
+    }
+}
+
+void suspend_wakeup_init_user(void) {
+    idle_power_wakeup();
+}
 
-struct td_mod_lsw_data {
-    enum td_mod_lsw_state state;
+// Modifier keys with zero-delay hold and actions bound to multiple taps
+// (`mod_tap_actions[]`).  The first press of such key registers the
+// modifier immediately, without waiting for the tapping term like a tap dance
+// does; if the key is pressed again within its tapping term, the action bound
+// to the double tap (and then to the triple tap) is performed instead of the
+// modifier while the key is held.  After the last bound action, or if an event
+// for any other key happens between the taps, the tap count starts again from
+// the modifier.  The U_LSW and U_LSWS actions send the language switch
+// chord (without and with Shift).
+//
+// Because the modifier is registered immediately, the first tap of a double
+// tap still reaches the host as a tap of that modifier (e.g., U_RALTG sends a
+// Right Alt tap before Right GUI).  A lone Alt tap activates the menu bar on
+// some hosts, therefore MOD_TAP_NEUTRALIZER is tapped before releasing an Alt
+// modifier if no other key was pressed while it was held.
+#define MOD_TAP_ACTIONS 2
+#define MOD_TAP_NEUTRALIZER KC_RCTL
+
+typedef struct {
+    uint16_t keycode;
+    uint16_t mod;
+    uint16_t actions[MOD_TAP_ACTIONS]; // double tap, triple tap
+} mod_tap_action_t;
+
+static const mod_tap_action_t PROGMEM mod_tap_actions[] = {
+    {U_LSFTL, KC_LSFT, {U_LSW}},
+    {U_RSFTL, KC_RSFT, {U_LSWS}},
+    {U_RALTG, KC_RALT, {KC_RGUI, RGUI(KC_RALT)}},
 };
 
-struct td_mod_lsw_global_data {
-    uint16_t td_kc;
+static struct {
+    uint16_t keycode; // the last pressed key, or KC_NO after any other key
     uint16_t time;
     uint8_t  tap_count;
-};
+} mod_tap_last;
 
-struct td_mod_lsw_global_data td_mod_lsw;
+// Tap count which selected the action for every currently held key (0 if the
+// key is not held).
+static uint8_t mod_tap_active[ARRAY_SIZE(mod_tap_actions)];
 
-static void td_mod_lsw_handle(bool pressed, uint16_t mod_kc, uint16_t lsw_kc, struct td_mod_lsw_data *data) {
-    if (pressed) {
-        switch (td_mod_lsw.tap_count) {
-            case 1:
-                data->state = TD_MOD_LSW_MOD;
-                break;
-            case 2:
-                data->state          = TD_MOD_LSW_LSW;
-                td_mod_lsw.tap_count = 0;
-                break;
-            default:
-                data->state = TD_MOD_LSW_NOOP;
-                break;
+static int8_t get_mod_tap_index(uint16_t keycode) {
+    for (uint8_t i = 0; i < ARRAY_SIZE(mod_tap_actions); ++i) {
+        if (pgm_read_word(&mod_tap_actions[i].keycode) == keycode) {
+            return i;
         }
     }
+    return -1;
+}
 
-    uint16_t kc;
-    switch (data->state) {
-        case TD_MOD_LSW_NOOP:
-            kc = KC_NO;
-            break;
-        case TD_MOD_LSW_MOD:
-            kc = mod_kc;
-            break;
-        case TD_MOD_LSW_LSW:
-            kc = lsw_kc;
-            break;
+static uint16_t get_mod_tap_action(uint8_t index, uint8_t tap_count) {
+    if (tap_count == 1) {
+        return pgm_read_word(&mod_tap_actions[index].mod);
     }
-    if (pressed) {
-        register_code16(kc);
-    } else {
-        unregister_code16(kc);
+    if (tap_count >= 2 && tap_count < 2 + MOD_TAP_ACTIONS) {
+        return pgm_read_word(&mod_tap_actions[index].actions[tap_count - 2]);
     }
+    return KC_NO;
 }
 
-static void process_td_mod_lsw(uint16_t td_kc, bool pressed, uint16_t mod_kc, uint16_t lsw_kc, struct td_mod_lsw_data *data) {
-    if (pressed) {
-        td_mod_lsw.td_kc = td_kc;
-        if (td_mod_lsw.tap_count > 0) {
-            if (timer_elapsed(td_mod_lsw.time) > TAPPING_TERM) {
-                td_mod_lsw.tap_count = 0;
+static void send_mod_tap_action(uint16_t action, bool pressed) {
+    switch (action) {
+        case U_LSW:
+        case U_LSWS:
+            send_lsw_chord(action == U_LSWS ? MOD_BIT(KC_LSFT) : 0, pressed);
+#ifdef KEY_STATS_ENABLE
+            if (pressed) {
+                key_stats_record_event(KEY_STATS_LSW_MOD_TAP);
+            }
+#endif
+            break;
+        default:
+            if (pressed) {
+                register_code16(action);
+            } else {
+                unregister_code16(action);
             }
+            break;
+    }
+}
+
+static bool process_record_mod_tap_action(uint16_t keycode, keyrecord_t *record) {
+    if ((mod_tap_last.keycode != KC_NO) && (keycode != mod_tap_last.keycode)) {
+        mod_tap_last.keycode   = KC_NO;
+        mod_tap_last.tap_count = 0;
+    }
+    int8_t index = get_mod_tap_index(keycode);
+    if (index < 0) {
+        return true;
+    }
+
+    if (record->event.pressed) {
+        if (mod_tap_last.tap_count > 0 && timer_elapsed(mod_tap_last.time) > get_tapping_term(keycode, record)) {
+            mod_tap_last.tap_count = 0;
+        }
+        mod_tap_last.keycode = keycode;
+        mod_tap_last.time    = timer_read();
+        if (get_mod_tap_action(index, ++mod_tap_last.tap_count) == KC_NO) {
+            mod_tap_last.tap_count = 1;
+        }
+        mod_tap_active[index] = mod_tap_last.tap_count;
+        if (mod_tap_last.tap_count > 1 && get_mod_tap_action(index, mod_tap_last.tap_count + 1) == KC_NO) {
+            mod_tap_last.tap_count = 0;
+        }
+#ifdef KEY_STATS_ENABLE
+        if (keycode == U_RALTG) {
+            key_stats_record_event(KEY_STATS_RALTG + mod_tap_active[index] - 1);
         }
-        td_mod_lsw.time = timer_read();
-        td_mod_lsw.tap_count++;
+#endif
+        send_mod_tap_action(get_mod_tap_action(index, mod_tap_active[index]), true);
+    } else if (mod_tap_active[index]) {
+        uint16_t action = get_mod_tap_action(index, mod_tap_active[index]);
+        if (mod_tap_active[index] == 1 && mod_tap_last.keycode == keycode && (MOD_BIT(action) & MOD_MASK_ALT)) {
+            tap_code(MOD_TAP_NEUTRALIZER);
+        }
+        send_mod_tap_action(action, false);
+        mod_tap_active[index] = 0;
     }
-    td_mod_lsw_handle(pressed, mod_kc, lsw_kc, data);
+    return false;
 }
 
-static struct td_mod_lsw_data u_lsftl_data;
-static struct td_mod_lsw_data u_rsftl_data;
+#ifdef KEY_STATS_ENABLE
+_Static_assert(LP_RGHT == KEY_STATS_POSITIONS, "Mismatched layout_positions and KEY_STATS_POSITIONS");
+_Static_assert(ARRAY_SIZE(keymaps) == KEY_STATS_LAYERS, "Mismatched layer count and KEY_STATS_LAYERS");
 
-static bool process_record_td_mod_lsw(uint16_t keycode, keyrecord_t *record) {
-    if ((td_mod_lsw.td_kc != KC_NO) && (keycode != td_mod_lsw.td_kc)) {
-        td_mod_lsw.td_kc     = KC_NO;
-        td_mod_lsw.tap_count = 0;
+static void record_key_stats(keyrecord_t *record, bool chatter) {
+    uint8_t position = get_layout_position(record->event.key);
+    if (position == LP_NONE || !record->event.pressed) {
+        return;
     }
-    switch (keycode) {
-        case U_LSFTL:
-            process_td_mod_lsw(keycode, record->event.pressed, KC_LSFT, get_lsw_keycode(), &u_lsftl_data);
-            break;
-        case U_RSFTL:
-            process_td_mod_lsw(keycode, record->event.pressed, KC_RSFT, S(get_lsw_keycode()), &u_rsftl_data);
-            break;
+    key_stats_record_press(layer_switch_get_layer(record->event.key), position - 1);
+    if (chatter) {
+        key_stats_record_chatter(position - 1);
     }
-    return true;
 }
+#endif
 
-#ifdef CONSOLE_ENABLE
-static uint16_t last_keycode;
-static uint16_t last_keycode_timestamps[4];
-static uint8_t last_keycode_index;
+#ifdef MODS_FUZZ_ENABLE
+// Keys for the modifier fuzzer (see mods_fuzz.c).
+static const uint8_t PROGMEM mods_fuzz_positions[] = {
+    LP_LSFT, LP_RSFT, LP_RCTL, LP_RALT, LP_LCTL, LP_LGUI, LP_LALT, LP_ESC,
+};
 
-bool pre_process_record_user(uint16_t keycode, keyrecord_t *record) {
-    if (keycode == last_keycode) {
-        if (last_keycode_index == ARRAY_SIZE(last_keycode_timestamps)) {
-            --last_keycode_index;
-            memmove(last_keycode_timestamps, last_keycode_timestamps + 1, sizeof(last_keycode_timestamps) - sizeof(last_keycode_timestamps[0]));
-        }
-        last_keycode_timestamps[last_keycode_index++] = timer_read();
-        if (last_keycode_index >= 3) {
-            uprintf("chatter(%u, %u):", (unsigned)keycode, (unsigned)record->event.pressed);
-            for (uint8_t i = 1; i < last_keycode_index; ++i) {
-                uprintf(" %u", (unsigned)(uint16_t)(last_keycode_timestamps[i] - last_keycode_timestamps[i-1]));
+static keypos_t mods_fuzz_keys[ARRAY_SIZE(mods_fuzz_positions)];
+
+static void start_mods_fuzz(void) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ARRAY_SIZE(mods_fuzz_positions); ++i) {
+        uint8_t position = pgm_read_byte(&mods_fuzz_positions[i]);
+        for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+            for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+                keypos_t key = {.row = row, .col = col};
+                if (get_layout_position(key) == position) {
+                    mods_fuzz_keys[count++] = key;
+                }
             }
-            uprintf("\n");
         }
-    } else {
-        last_keycode = keycode;
-        last_keycode_timestamps[0] = timer_read();
-        last_keycode_index = 1;
     }
+    mods_fuzz_start(mods_fuzz_keys, count);
+}
+#endif
+
+// Return false for the key events injected by the modifier fuzzer, which must
+// not affect the chatter detection, the statistics and the macro recording.
+static bool is_real_input(void) {
+#ifdef MODS_FUZZ_ENABLE
+    return !mods_fuzz_is_running();
+#else
     return true;
+#endif
 }
-#endif /* CONSOLE_ENABLE */
 
-bool process_record_user(uint16_t keycode, keyrecord_t *record) {
-    if (!process_record_td_mod_lsw(keycode, record)) {
+bool pre_process_record_user(uint16_t keycode, keyrecord_t *record) {
+    lang_shift_pre_process(keycode, record);
+    if (is_real_input()) {
+        bool chatter = adaptive_debounce_record(record);
+#ifdef KEY_STATS_ENABLE
+        record_key_stats(record, chatter);
+#else
+        (void)chatter;
+#endif
+    }
+
+#ifdef EVENT_TRACE_ENABLE
+    event_trace_record(keycode, record);
+#endif
+
+    return true;
+}
+
+static bool process_record_keymap(uint16_t keycode, keyrecord_t *record) {
+    if (is_real_input()) {
+        macro_record_event(keycode, record);
+    }
+
+    if (!process_record_mod_tap_action(keycode, record)) {
         return false;
     }
 
     switch (keycode) {
         case U_LSW:
+        case U_LSWS:
+            send_lsw_chord(keycode == U_LSWS ? MOD_BIT(KC_LSFT) : 0, record->event.pressed);
+#ifdef KEY_STATS_ENABLE
             if (record->event.pressed) {
-                register_code16(get_lsw_keycode());
-            } else {
-                unregister_code16(get_lsw_keycode());
+                key_stats_record_event(KEY_STATS_LSW_KEY);
             }
+#endif
             return false;
 
-        case U_LSWM0:
+        case U_LSWM0 ... U_LSWM1:
+        case U_LSWM2 ... U_LSWM4:
             if (record->event.pressed) {
-                user_config.lang_switch_mode = 0;
-                eeconfig_update_user(user_config.raw);
-            }
-            return false;
-
-        case U_LSWM1:
-            if (record->event.pressed) {
-                user_config.lang_switch_mode = 1;
-                eeconfig_update_user(user_config.raw);
+                user_config.lang_switch_mode = keycode <= U_LSWM1 ? LSW_MODE_CAPS + (keycode - U_LSWM0) : LSW_MODE_ALT_SHIFT + (keycode - U_LSWM2);
+                user_settings_save();
+                update_indicators(layer_state);
             }
             return false;
 
@@ -518,9 +1004,279 @@ bool process_record_user(uint16_t keycode, keyrecord_t *record) {
             }
             return true; // Pass the keycode to the tap dance handler.
 
+        case U_TTDN:
+            if (record->event.pressed) {
+                adjust_tapping_term(-TAPPING_TERM_STEP);
+            }
+            return false;
+
+        case U_TTUP:
+            if (record->event.pressed) {
+                adjust_tapping_term(TAPPING_TERM_STEP);
+            }
+            return false;
+
+        case U_TTPRT:
+            if (record->event.pressed) {
+                send_tapping_term();
+            }
+            return false;
+
+        case U_TTNXT:
+            if (record->event.pressed) {
+                tapping_term_index = (tapping_term_index + 1) % TAPPING_TERM_KEY_COUNT;
+            }
+            return false;
+
+        case U_MREC1 ... U_MREC4:
+            if (record->event.pressed) {
+                if (macro_is_recording()) {
+                    macro_record_stop();
+                } else {
+                    macro_record_start(keycode - U_MREC1);
+                }
+            }
+            return false;
+
+        case U_MPLY1 ... U_MPLY4:
+            if (record->event.pressed) {
+                macro_play(keycode - U_MPLY1);
+            }
+            return false;
+
+        case U_MSTOP:
+            if (record->event.pressed) {
+                macro_stop();
+            }
+            return false;
+
+        case U_MRATE:
+            if (record->event.pressed) {
+                user_config.macro_rate = (user_config.macro_rate + 1) % MACRO_RATE_COUNT;
+                user_settings_save();
+            }
+            return false;
+
+        case U_IDLE:
+            if (record->event.pressed) {
+                idle_power_next_timeout();
+            }
+            return false;
+
+        case U_STATS:
+#ifdef LATENCY_STATS_ENABLE
+            if (record->event.pressed) {
+                latency_stats_send();
+            }
+#endif
+            return false;
+
+        case U_MFUZZ:
+#ifdef MODS_FUZZ_ENABLE
+            if (record->event.pressed) {
+                start_mods_fuzz();
+            }
+#endif
+            return false;
+
         default:
             return true;
     }
 }
 
+bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+#ifdef LATENCY_STATS_ENABLE
+    uint32_t start  = latency_stats_start();
+    bool     result = process_record_keymap(keycode, record);
+    latency_stats_record(start, record);
+    return result;
+#else
+    return process_record_keymap(keycode, record);
+#endif
+}
+
+#ifdef RAW_ENABLE
+// Raw HID commands (the first byte of the request; the response starts with
+// the same byte, or with RAW_HID_ERROR if the command is not supported or has
+// failed).  Keycode targets are described in keymap_overrides.h (layout
+// positions start from 1, in the order of LAYOUT_65_ansi_blocker_tsangan_split_bs()
+// arguments); user_config_t fields are accessed by their offsets.
+enum raw_hid_commands {
+    RAW_HID_KEY_STATS_INFO = 0x01,   // response: layers, positions, events, counter size
+    RAW_HID_KEY_STATS_READ,          // request: byte offset (LE16); response: offset, table data
+    RAW_HID_KEY_STATS_RESET,
+    RAW_HID_LATENCY_STATS_READ,      // request: histogram; response: histogram, data (see latency_stats.h)
+    RAW_HID_LATENCY_STATS_RESET,
+    RAW_HID_CONFIG_INFO = 0x10,      // response: size (LE16), MATRIX_ROWS, MATRIX_COLS
+    RAW_HID_CONFIG_READ,             // request: offset (LE16), size; response: offset, size, data
+    RAW_HID_CONFIG_WRITE,            // request: offset (LE16), size, data
+    RAW_HID_KEYCODE_READ = 0x20,     // request: target, index; response: target, index, keycode (LE16)
+    RAW_HID_KEYCODE_WRITE,           // request: target, index, keycode (LE16)
+    RAW_HID_KEYCODE_RESET,           // request: target, index (remove the override)
+    RAW_HID_KEYCODE_RESET_ALL,       // remove all overrides
+    RAW_HID_EVENT_TRACE_READ = 0x30, // response: count, dropped, records (see event_trace.h)
+    RAW_HID_ERROR = 0xff,
+};
+
+// Get the current keycode for the override target and index; returns false if
+// the target or index is not valid.
+static bool get_target_keycode(uint8_t target, uint8_t index, uint16_t *keycode) {
+    if (target & KEYMAP_OVERRIDE_TAP_DANCE) {
+        if (target != (KEYMAP_OVERRIDE_TAP_DANCE | TD_RCTL) || index >= ARRAY_SIZE(td_rctl_keycodes)) {
+            return false;
+        }
+        *keycode = td_rctl_keycode(index);
+        return true;
+    }
+
+    if (target >= ARRAY_SIZE(keymaps)) {
+        return false;
+    }
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            keypos_t key = {.row = row, .col = col};
+            if (index != LP_NONE && get_layout_position(key) == index) {
+                *keycode = get_layer_keycode(target, key);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Check the values of all user_config_t fields which are not allowed to have
+// arbitrary values.
+static bool user_config_is_valid(const user_config_t *config) {
+    if (config->lang_switch_mode >= LSW_MODE_COUNT || config->macro_rate >= MACRO_RATE_COUNT) {
+        return false;
+    }
+    for (uint8_t i = 0; i < TAPPING_TERM_KEY_COUNT; ++i) {
+        uint16_t term = config->tapping_term[i];
+        if (term != 0 && (term < TAPPING_TERM_MIN || term > TAPPING_TERM_MAX)) {
+            return false;
+        }
+    }
+    uint8_t max_chatter_count = adaptive_debounce_max_chatter_count();
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            if (config->chatter_count[row][col] > max_chatter_count) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool raw_hid_config_access(uint8_t *data, uint8_t length, bool write) {
+    uint16_t offset = data[1] | (data[2] << 8);
+    uint8_t  size   = data[3];
+    if (size > length - 4 || offset + size > sizeof(user_config)) {
+        return false;
+    }
+
+    if (write) {
+        // Apply the change to a copy first, so that invalid values are never
+        // used by the firmware.
+        user_config_t config = user_config;
+        memcpy((uint8_t *)&config + offset, &data[4], size);
+        if (!user_config_is_valid(&config)) {
+            return false;
+        }
+        user_config = config;
+        user_settings_save();
+        update_indicators(layer_state);
+    } else {
+        memcpy(&data[4], (uint8_t *)&user_config + offset, size);
+    }
+    return true;
+}
+
+void raw_hid_receive(uint8_t *data, uint8_t length) {
+    bool     ok      = true;
+    uint16_t keycode = KC_NO;
+
+    switch (data[0]) {
+#    ifdef KEY_STATS_ENABLE
+        case RAW_HID_KEY_STATS_INFO:
+            data[1] = KEY_STATS_LAYERS;
+            data[2] = KEY_STATS_POSITIONS;
+            data[3] = KEY_STATS_EVENTS;
+            data[4] = sizeof(key_stats_counter_t);
+            break;
+
+        case RAW_HID_KEY_STATS_READ:
+            key_stats_read(data[1] | (data[2] << 8), &data[3], length - 3);
+            break;
+
+        case RAW_HID_KEY_STATS_RESET:
+            key_stats_reset();
+            break;
+#    endif
+
+#    ifdef LATENCY_STATS_ENABLE
+        case RAW_HID_LATENCY_STATS_READ:
+            ok = latency_stats_read(data[1], &data[2], length - 2);
+            break;
+
+        case RAW_HID_LATENCY_STATS_RESET:
+            latency_stats_reset();
+            break;
+#    endif
+
+        case RAW_HID_CONFIG_INFO:
+            data[1] = sizeof(user_config) & 0xff;
+            data[2] = sizeof(user_config) >> 8;
+            data[3] = MATRIX_ROWS;
+            data[4] = MATRIX_COLS;
+            break;
+
+        case RAW_HID_CONFIG_READ:
+            ok = raw_hid_config_access(data, length, false);
+            break;
+
+        case RAW_HID_CONFIG_WRITE:
+            ok = raw_hid_config_access(data, length, true);
+            break;
+
+        case RAW_HID_KEYCODE_READ:
+            ok      = get_target_keycode(data[1], data[2], &keycode);
+            data[3] = keycode & 0xff;
+            data[4] = keycode >> 8;
+            break;
+
+        case RAW_HID_KEYCODE_WRITE:
+            ok = get_target_keycode(data[1], data[2], &keycode) && keymap_override_set(data[1], data[2], data[3] | (data[4] << 8));
+            keycode_cache_invalidate();
+            break;
+
+        case RAW_HID_KEYCODE_RESET:
+            ok = get_target_keycode(data[1], data[2], &keycode);
+            if (ok) {
+                keymap_override_remove(data[1], data[2]);
+            }
+            keycode_cache_invalidate();
+            break;
+
+        case RAW_HID_KEYCODE_RESET_ALL:
+            keymap_overrides_reset();
+            keycode_cache_invalidate();
+            break;
+
+#    ifdef EVENT_TRACE_ENABLE
+        case RAW_HID_EVENT_TRACE_READ:
+            data[1] = event_trace_read(&data[3], length - 3, &data[2]);
+            break;
+#    endif
+
+        default:
+            ok = false;
+            break;
+    }
+    if (!ok) {
+        data[0] = RAW_HID_ERROR;
+    }
+    raw_hid_send(data, length);
+}
+#endif
+
 /* vim:set sw=4 sta et: */
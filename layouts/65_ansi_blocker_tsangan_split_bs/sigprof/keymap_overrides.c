@@ -0,0 +1,139 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Keycode overrides which can be changed at runtime (over raw HID) without
+// reflashing the firmware.  The overrides are kept in RAM as a small unsorted
+// table of (target, index, keycode) entries, which is written to the EEPROM
+// user datablock (after the macro slots) when there was no input activity for
+// KEYMAP_OVERRIDES_FLUSH_DELAY ms after a change.  The header records the
+// keycode numbering versions, because the stored keycodes are meaningless if
+// the keycodes are renumbered.
+
+#include "keymap_overrides.h"
+#include "eeconfig.h"
+
+#define KEYMAP_OVERRIDES_VERSION 1
+
+#ifndef QMK_KEYCODES_VERSION_BCD
+#    define QMK_KEYCODES_VERSION_BCD 0
+#endif
+
+#ifndef KEYMAP_OVERRIDES_FLUSH_DELAY
+#    define KEYMAP_OVERRIDES_FLUSH_DELAY 3000
+#endif
+
+typedef struct {
+    uint8_t  target;
+    uint8_t  index;
+    uint16_t keycode;
+} keymap_override_t;
+
+typedef struct {
+    uint8_t  version;
+    uint8_t  count;
+    uint8_t  checksum;
+    uint8_t  custom_keycodes_version;
+    uint32_t qmk_keycodes_version; // QMK_KEYCODES_VERSION_BCD
+} keymap_overrides_header_t;
+
+_Static_assert(sizeof(keymap_overrides_header_t) + KEYMAP_OVERRIDE_COUNT * sizeof(keymap_override_t) <= KEYMAP_OVERRIDES_STORAGE_SIZE, "KEYMAP_OVERRIDES_STORAGE_SIZE is too small");
+_Static_assert(USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + MACRO_SLOT_SIZE * MACRO_SLOT_COUNT + KEYMAP_OVERRIDES_STORAGE_SIZE <= EECONFIG_USER_DATA_SIZE, "EECONFIG_USER_DATA_SIZE is too small for the keymap overrides");
+
+static keymap_override_t overrides[KEYMAP_OVERRIDE_COUNT];
+static uint8_t           override_count;
+static bool              overrides_dirty;
+static uint8_t           overrides_custom_keycodes_version;
+
+// Offset of the overrides in the user datablock.
+#define STORAGE_OFFSET (USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + MACRO_SLOT_SIZE * MACRO_SLOT_COUNT)
+
+static uint8_t overrides_checksum(uint8_t count) {
+    const uint8_t *data  = (const uint8_t *)overrides;
+    uint8_t        check = ~count;
+
+    for (uint16_t i = 0; i < count * sizeof(keymap_override_t); ++i) {
+        check = ((check << 1) | (check >> 7)) ^ data[i];
+    }
+    return check;
+}
+
+void keymap_overrides_init(uint8_t custom_keycodes_version) {
+    keymap_overrides_header_t header;
+
+    override_count                    = 0;
+    overrides_custom_keycodes_version = custom_keycodes_version;
+    eeconfig_read_user_datablock(&header, STORAGE_OFFSET, sizeof(header));
+    if (header.version != KEYMAP_OVERRIDES_VERSION || header.count > KEYMAP_OVERRIDE_COUNT) {
+        return;
+    }
+    if (header.custom_keycodes_version != custom_keycodes_version || header.qmk_keycodes_version != QMK_KEYCODES_VERSION_BCD) {
+        return;
+    }
+    eeconfig_read_user_datablock(overrides, STORAGE_OFFSET + sizeof(header), header.count * sizeof(keymap_override_t));
+    if (header.checksum == overrides_checksum(header.count)) {
+        override_count = header.count;
+    }
+}
+
+static int8_t find_override(uint8_t target, uint8_t index) {
+    for (uint8_t i = 0; i < override_count; ++i) {
+        if (overrides[i].target == target && overrides[i].index == index) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool keymap_override_get(uint8_t target, uint8_t index, uint16_t *keycode) {
+    int8_t i = find_override(target, index);
+    if (i < 0) {
+        return false;
+    }
+    *keycode = overrides[i].keycode;
+    return true;
+}
+
+bool keymap_override_set(uint8_t target, uint8_t index, uint16_t keycode) {
+    int8_t i = find_override(target, index);
+    if (i < 0) {
+        if (override_count >= KEYMAP_OVERRIDE_COUNT) {
+            return false;
+        }
+        i                   = override_count++;
+        overrides[i].target = target;
+        overrides[i].index  = index;
+    }
+    overrides[i].keycode = keycode;
+    overrides_dirty      = true;
+    return true;
+}
+
+void keymap_override_remove(uint8_t target, uint8_t index) {
+    int8_t i = find_override(target, index);
+    if (i >= 0) {
+        overrides[i]    = overrides[--override_count];
+        overrides_dirty = true;
+    }
+}
+
+void keymap_overrides_reset(void) {
+    override_count  = 0;
+    overrides_dirty = true;
+}
+
+void keymap_overrides_task(void) {
+    if (!overrides_dirty || last_input_activity_elapsed() < KEYMAP_OVERRIDES_FLUSH_DELAY) {
+        return;
+    }
+
+    keymap_overrides_header_t header = {
+        .version                 = KEYMAP_OVERRIDES_VERSION,
+        .count                   = override_count,
+        .checksum                = overrides_checksum(override_count),
+        .custom_keycodes_version = overrides_custom_keycodes_version,
+        .qmk_keycodes_version    = QMK_KEYCODES_VERSION_BCD,
+    };
+    eeconfig_update_user_datablock(overrides, STORAGE_OFFSET + sizeof(header), override_count * sizeof(keymap_override_t));
+    eeconfig_update_user_datablock(&header, STORAGE_OFFSET, sizeof(header));
+    overrides_dirty = false;
+}
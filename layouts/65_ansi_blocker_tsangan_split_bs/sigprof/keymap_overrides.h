@@ -0,0 +1,33 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Override targets: a layer number (the index is the layout position), or
+// KEYMAP_OVERRIDE_TAP_DANCE | tap dance index (only TD_RCTL, the index is the
+// tap dance state).
+#define KEYMAP_OVERRIDE_TAP_DANCE 0x80
+
+// Load the overrides from EEPROM.  The overrides are discarded if they were
+// saved with a different custom keycodes version (which must be changed
+// whenever the existing custom keycodes or tap dance indexes are renumbered)
+// or a different QMK keycodes version.
+void keymap_overrides_init(uint8_t custom_keycodes_version);
+
+// Get the override for the specified target and index; returns false if there
+// is no such override.
+bool keymap_override_get(uint8_t target, uint8_t index, uint16_t *keycode);
+
+// Add or change an override; returns false if there is no free space.
+bool keymap_override_set(uint8_t target, uint8_t index, uint16_t keycode);
+
+// Remove the override for the specified target and index.
+void keymap_override_remove(uint8_t target, uint8_t index);
+
+// Remove all overrides.
+void keymap_overrides_reset(void);
+
+// Write the changed overrides to EEPROM if the keyboard is idle.
+void keymap_overrides_task(void);
@@ -0,0 +1,152 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Optional instrumentation (enabled by `LATENCY_STATS_ENABLE = yes`):
+// - matrix scan rate (scans per second, measured over the last second);
+// - time spent in process_record_user() for every key event (in µs; the
+//   actual resolution is one system tick on ChibiOS and 1 ms on AVR);
+// - delay between the key event timestamp and the end of processing for that
+//   event (in ms).
+// The times are collected into histograms with power of 2 buckets, which are
+// used to report the approximate 99th percentile.
+// The statistics are typed by the U_STATS key or read over raw HID.
+
+#include "latency_stats.h"
+
+#ifdef PROTOCOL_CHIBIOS
+#    include <ch.h>
+#endif
+
+#define LATENCY_STATS_BUCKETS 16
+
+typedef struct {
+    uint32_t count;
+    uint32_t sum;
+    uint32_t min;
+    uint32_t max;
+    uint16_t buckets[LATENCY_STATS_BUCKETS];
+} latency_histogram_t;
+
+static latency_histogram_t histograms[LATENCY_STATS_HISTOGRAMS];
+static uint16_t            scan_count;
+static uint16_t            scan_rate;
+static uint16_t            scan_timer;
+
+uint32_t latency_stats_start(void) {
+#ifdef PROTOCOL_CHIBIOS
+    return chVTGetSystemTimeX();
+#else
+    return timer_read32();
+#endif
+}
+
+static uint32_t elapsed_us(uint32_t start) {
+#ifdef PROTOCOL_CHIBIOS
+    return TIME_I2US(chTimeDiffX((systime_t)start, chVTGetSystemTimeX()));
+#else
+    return timer_elapsed32(start) * 1000;
+#endif
+}
+
+static void histogram_add(latency_histogram_t *hist, uint32_t value) {
+    uint8_t bucket = 0;
+    while (bucket < LATENCY_STATS_BUCKETS - 1 && (value >> bucket) != 0) {
+        ++bucket;
+    }
+    if (hist->buckets[bucket] < UINT16_MAX) {
+        ++hist->buckets[bucket];
+    }
+    if (hist->count == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    ++hist->count;
+    hist->sum += value;
+}
+
+// Return the upper bound of the histogram bucket which contains the 99th
+// percentile (limited by the actual maximum value).
+static uint32_t histogram_p99(const latency_histogram_t *hist) {
+    uint32_t threshold = hist->count - hist->count / 100;
+    uint32_t total     = 0;
+    for (uint8_t bucket = 0; bucket < LATENCY_STATS_BUCKETS; ++bucket) {
+        total += hist->buckets[bucket];
+        if (total >= threshold) {
+            uint32_t limit = ((uint32_t)1 << bucket) - 1;
+            return limit < hist->max ? limit : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void latency_stats_record(uint32_t start, keyrecord_t *record) {
+    histogram_add(&histograms[LATENCY_STATS_PROCESSING_TIME], elapsed_us(start));
+    // The event timestamp is rounded to an odd value (0 means "no event"), so
+    // the current time must be rounded in the same way to avoid wraparound.
+    histogram_add(&histograms[LATENCY_STATS_EVENT_DELAY], TIMER_DIFF_16(timer_read() | 1, record->event.time));
+}
+
+void latency_stats_task(void) {
+    ++scan_count;
+    if (timer_elapsed(scan_timer) >= 1000) {
+        scan_rate  = scan_count;
+        scan_count = 0;
+        scan_timer = timer_read();
+    }
+}
+
+static void send_histogram(const char *name, const latency_histogram_t *hist) {
+    char buf[64];
+    if (hist->count == 0) {
+        snprintf(buf, sizeof(buf), " %s:-", name);
+    } else {
+        snprintf(buf, sizeof(buf), " %s:%lu/%lu/%lu", name, (unsigned long)hist->min, (unsigned long)(hist->sum / hist->count), (unsigned long)histogram_p99(hist));
+    }
+    send_string(buf);
+}
+
+void latency_stats_send(void) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "scan/s:%u", (unsigned)scan_rate);
+    send_string(buf);
+    send_histogram("proc_us", &histograms[LATENCY_STATS_PROCESSING_TIME]);
+    send_histogram("delay_ms", &histograms[LATENCY_STATS_EVENT_DELAY]);
+    send_string("\n");
+
+    latency_stats_reset();
+}
+
+static uint8_t *store_le32(uint8_t *data, uint32_t value) {
+    data[0] = value & 0xff;
+    data[1] = (value >> 8) & 0xff;
+    data[2] = (value >> 16) & 0xff;
+    data[3] = value >> 24;
+    return data + 4;
+}
+
+bool latency_stats_read(uint8_t histogram, uint8_t *data, uint8_t size) {
+    if (histogram >= LATENCY_STATS_HISTOGRAMS || size < LATENCY_STATS_READ_SIZE) {
+        return false;
+    }
+
+    const latency_histogram_t *hist = &histograms[histogram];
+
+    data[0] = scan_rate & 0xff;
+    data[1] = scan_rate >> 8;
+    data    = store_le32(data + 2, hist->count);
+    if (hist->count == 0) {
+        memset(data, 0, 4 * sizeof(uint32_t));
+        return true;
+    }
+    data = store_le32(data, hist->min);
+    data = store_le32(data, hist->sum / hist->count);
+    data = store_le32(data, histogram_p99(hist));
+    store_le32(data, hist->max);
+    return true;
+}
+
+void latency_stats_reset(void) {
+    memset(histograms, 0, sizeof(histograms));
+}
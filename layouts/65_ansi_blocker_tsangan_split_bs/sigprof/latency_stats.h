@@ -0,0 +1,37 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Get the timestamp for the start of key event processing.
+uint32_t latency_stats_start(void);
+
+// Record the processing time for the key event which was started at `start`,
+// and the delay between the key event timestamp and the end of processing.
+void latency_stats_record(uint32_t start, keyrecord_t *record);
+
+// Count matrix scans (must be called once per main loop iteration).
+void latency_stats_task(void);
+
+// Type the collected statistics and reset them.
+void latency_stats_send(void);
+
+// Histograms which can be read with latency_stats_read().
+enum latency_stats_histogram {
+    LATENCY_STATS_PROCESSING_TIME, // µs
+    LATENCY_STATS_EVENT_DELAY,     // ms
+    LATENCY_STATS_HISTOGRAMS,
+};
+
+#define LATENCY_STATS_READ_SIZE 22
+
+// Store the scan rate (LE16) and the summary of the specified histogram (count,
+// min, average, 99th percentile and max, each LE32) into `data`.  Returns false
+// if the histogram number is invalid or `size` is less than
+// LATENCY_STATS_READ_SIZE.  The statistics are not reset.
+bool latency_stats_read(uint8_t histogram, uint8_t *data, uint8_t size);
+
+// Reset the collected statistics.
+void latency_stats_reset(void);
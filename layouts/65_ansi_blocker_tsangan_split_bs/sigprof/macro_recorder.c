@@ -0,0 +1,309 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Macro recorder with persistent storage.  Macros are stored in the EEPROM
+// user datablock after the settings slots, in MACRO_SLOT_COUNT slots of
+// MACRO_SLOT_SIZE bytes.  Every slot contains a header with the number of
+// events and a checksum, followed by the events; every event takes 2 bytes:
+// - bit 7 of the first byte is set for a key press and clear for a release;
+// - bits 0...6 of the first byte contain the time since the previous event in
+//   MACRO_TIME_UNIT ms units (longer pauses are shortened to the maximum);
+// - the second byte contains a basic keycode.
+//
+// Only the keycodes which resolve to basic keycodes are recorded (the tap
+// keycodes of mod-tap and layer-tap keys are recorded when those keys are
+// tapped; layer switching is not recorded, because the keycodes are recorded
+// after the layer lookup).  The modifier state is sampled at every recorded
+// event, therefore the modifiers registered by tap dances and other custom
+// keys are also recorded; modifiers which were already held when the
+// recording was started are ignored.
+//
+// The macro being recorded or played is kept in RAM; playback is performed by
+// macro_task() with the rate selected by `user_config.macro_rate`.  A recorded
+// macro is not written immediately: macro_task() writes it when there was no
+// input activity for MACRO_FLUSH_DELAY ms (or it is written before the buffer
+// is reused for another slot).
+
+#include "macro_recorder.h"
+#include "eeconfig.h"
+#include "user_settings.h"
+
+#ifndef MACRO_TIME_UNIT
+#    define MACRO_TIME_UNIT 8
+#endif
+
+#ifndef MACRO_FLUSH_DELAY
+#    define MACRO_FLUSH_DELAY 3000
+#endif
+
+#define MACRO_EVENT_PRESSED 0x80
+#define MACRO_EVENT_DELAY 0x7f
+
+typedef struct {
+    uint8_t info;    // MACRO_EVENT_PRESSED | delay
+    uint8_t keycode; // basic keycode
+} macro_event_t;
+
+typedef struct {
+    uint8_t count;
+    uint8_t checksum;
+} macro_header_t;
+
+#define MACRO_EVENTS ((MACRO_SLOT_SIZE - sizeof(macro_header_t)) / sizeof(macro_event_t))
+
+_Static_assert(sizeof(macro_event_t) == 2, "Unexpected macro_event_t size");
+_Static_assert(MACRO_EVENTS <= UINT8_MAX, "MACRO_SLOT_SIZE is too large");
+_Static_assert(USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + MACRO_SLOT_SIZE * MACRO_SLOT_COUNT <= EECONFIG_USER_DATA_SIZE, "EECONFIG_USER_DATA_SIZE is too small for the macro slots");
+
+enum macro_states {
+    MACRO_IDLE,
+    MACRO_RECORDING,
+    MACRO_PLAYING,
+};
+
+static uint8_t       macro_state;
+static uint8_t       macro_slot;
+static uint8_t       macro_count;         // number of events in `macro_buffer[]`
+static uint8_t       macro_position;      // index of the next event to play
+static uint16_t      macro_time;          // time of the last recorded or played event
+static uint8_t       macro_mods;          // modifiers pressed in the recording
+static uint8_t       macro_ignored_mods;  // modifiers held when the recording was started
+static uint8_t       macro_keys_down[32]; // bitmap of keys pressed by the playback
+static bool          macro_dirty;         // `macro_buffer[]` contains an unsaved recording for `macro_slot`
+static macro_event_t macro_buffer[MACRO_EVENTS];
+
+// Offset of the slot in the user datablock.
+static uint16_t slot_offset(uint8_t slot) {
+    return USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT + (uint16_t)slot * MACRO_SLOT_SIZE;
+}
+
+static uint8_t macro_checksum(uint8_t count) {
+    const uint8_t *data  = (const uint8_t *)macro_buffer;
+    uint8_t        check = ~count;
+
+    for (uint16_t i = 0; i < count * sizeof(macro_event_t); ++i) {
+        check = ((check << 1) | (check >> 7)) ^ data[i];
+    }
+    return check;
+}
+
+// Write the recorded macro to EEPROM if it was not written yet.
+static void macro_flush(void) {
+    if (!macro_dirty) {
+        return;
+    }
+
+    macro_header_t header = {.count = macro_count, .checksum = macro_checksum(macro_count)};
+    uint16_t       offset = slot_offset(macro_slot);
+    eeconfig_update_user_datablock(macro_buffer, offset + sizeof(header), macro_count * sizeof(macro_event_t));
+    eeconfig_update_user_datablock(&header, offset, sizeof(header));
+    macro_dirty = false;
+}
+
+static void append_event(uint8_t keycode, bool pressed, uint16_t time) {
+    uint16_t delay = 0;
+
+    if (macro_count >= MACRO_EVENTS) {
+        return;
+    }
+    if (macro_count > 0) {
+        delay = TIMER_DIFF_16(time, macro_time) / MACRO_TIME_UNIT;
+        if (delay > MACRO_EVENT_DELAY) {
+            delay = MACRO_EVENT_DELAY;
+        }
+    }
+    macro_time                        = time;
+    macro_buffer[macro_count].info    = (pressed ? MACRO_EVENT_PRESSED : 0) | delay;
+    macro_buffer[macro_count].keycode = keycode;
+    ++macro_count;
+}
+
+static void record_mods(uint8_t mods, uint16_t time) {
+    macro_ignored_mods &= mods;
+    mods &= ~macro_ignored_mods;
+
+    uint8_t changed = mods ^ macro_mods;
+    for (uint8_t i = 0; i < 8; ++i) {
+        if (changed & (1 << i)) {
+            append_event(KC_LEFT_CTRL + i, mods & (1 << i), time);
+        }
+    }
+    macro_mods = mods;
+}
+
+void macro_record_start(uint8_t slot) {
+    macro_stop();
+    if (slot >= MACRO_SLOT_COUNT) {
+        return;
+    }
+    macro_flush();
+    macro_state        = MACRO_RECORDING;
+    macro_slot         = slot;
+    macro_count        = 0;
+    macro_mods         = 0;
+    macro_ignored_mods = get_mods() | get_oneshot_mods();
+}
+
+void macro_record_stop(void) {
+    if (macro_state != MACRO_RECORDING) {
+        return;
+    }
+    record_mods(0, macro_time);
+    macro_dirty = true;
+    macro_state = MACRO_IDLE;
+}
+
+bool macro_is_recording(void) {
+    return macro_state == MACRO_RECORDING;
+}
+
+bool macro_is_playing(void) {
+    return macro_state == MACRO_PLAYING;
+}
+
+void macro_record_event(uint16_t keycode, keyrecord_t *record) {
+    if (macro_state != MACRO_RECORDING) {
+        return;
+    }
+
+    uint8_t key_mods = 0;
+    if (IS_QK_MODS(keycode)) {
+        key_mods = QK_MODS_GET_MODS(keycode);
+        key_mods = (key_mods & 0x10) ? (key_mods & 0x0f) << 4 : key_mods;
+        keycode  = QK_MODS_GET_BASIC_KEYCODE(keycode);
+    } else if (IS_QK_MOD_TAP(keycode) && record->tap.count > 0) {
+        keycode = QK_MOD_TAP_GET_TAP_KEYCODE(keycode);
+    } else if (IS_QK_LAYER_TAP(keycode) && record->tap.count > 0) {
+        keycode = QK_LAYER_TAP_GET_TAP_KEYCODE(keycode);
+    }
+    if (keycode > QK_BASIC_MAX || keycode == KC_NO || keycode == KC_TRNS) {
+        return;
+    }
+
+    // Modifier keycodes are recorded through the modifier state, because the
+    // state is sampled before the modifier keycode itself is handled.
+    uint8_t mods    = get_mods() | get_oneshot_mods();
+    uint8_t key_bit = 0;
+    if (IS_MODIFIER_KEYCODE(keycode)) {
+        key_bit = MOD_BIT(keycode);
+        keycode = KC_NO;
+    }
+
+    uint16_t time = record->event.time;
+    if (record->event.pressed) {
+        record_mods(mods | key_mods | key_bit, time);
+        if (keycode != KC_NO) {
+            append_event(keycode, true, time);
+        }
+    } else {
+        if (keycode != KC_NO) {
+            append_event(keycode, false, time);
+        }
+        record_mods(mods & ~key_bit, time);
+    }
+
+    if (macro_count >= MACRO_EVENTS) {
+        macro_record_stop();
+    }
+}
+
+void macro_play(uint8_t slot) {
+    macro_header_t header;
+
+    if (macro_state == MACRO_RECORDING || slot >= MACRO_SLOT_COUNT) {
+        return;
+    }
+    macro_stop();
+
+    if (macro_dirty && slot == macro_slot) {
+        // The unsaved recording for this slot is still in the buffer.
+        if (macro_count == 0) {
+            return;
+        }
+    } else {
+        macro_flush();
+        uint16_t offset = slot_offset(slot);
+        eeconfig_read_user_datablock(&header, offset, sizeof(header));
+        if (header.count == 0 || header.count > MACRO_EVENTS) {
+            return;
+        }
+        eeconfig_read_user_datablock(macro_buffer, offset + sizeof(header), header.count * sizeof(macro_event_t));
+        if (header.checksum != macro_checksum(header.count)) {
+            return;
+        }
+        macro_count = header.count;
+    }
+
+    macro_state    = MACRO_PLAYING;
+    macro_position = 0;
+    macro_time     = timer_read();
+}
+
+void macro_stop(void) {
+    switch (macro_state) {
+        case MACRO_RECORDING:
+            macro_record_stop();
+            break;
+
+        case MACRO_PLAYING:
+            // Release the keys which remained pressed at the end of the macro
+            // (or when the playback was interrupted).
+            for (uint16_t i = 0; i < sizeof(macro_keys_down) * 8; ++i) {
+                if (macro_keys_down[i / 8] & (1 << (i % 8))) {
+                    unregister_code(i);
+                }
+            }
+            memset(macro_keys_down, 0, sizeof(macro_keys_down));
+            macro_state = MACRO_IDLE;
+            break;
+    }
+}
+
+static uint16_t get_event_delay(macro_event_t *event) {
+    uint16_t delay = (event->info & MACRO_EVENT_DELAY) * MACRO_TIME_UNIT;
+
+    switch (user_config.macro_rate) {
+        case MACRO_RATE_BATCH:
+            return 0;
+
+        case MACRO_RATE_FAST:
+            return delay / 4;
+
+        case MACRO_RATE_HALF:
+            return delay / 2;
+
+        case MACRO_RATE_RECORDED:
+        default:
+            return delay;
+    }
+}
+
+void macro_task(void) {
+    if (macro_dirty && macro_state != MACRO_RECORDING && last_input_activity_elapsed() >= MACRO_FLUSH_DELAY) {
+        macro_flush();
+    }
+    if (macro_state != MACRO_PLAYING) {
+        return;
+    }
+
+    while (macro_position < macro_count) {
+        macro_event_t *event = &macro_buffer[macro_position];
+        uint16_t       delay = get_event_delay(event);
+        if (TIMER_DIFF_16(timer_read(), macro_time) < delay) {
+            return;
+        }
+        macro_time += delay;
+        ++macro_position;
+
+        uint8_t *down = &macro_keys_down[event->keycode / 8];
+        uint8_t  mask = 1 << (event->keycode % 8);
+        if (event->info & MACRO_EVENT_PRESSED) {
+            register_code(event->keycode);
+            *down |= mask;
+        } else {
+            unregister_code(event->keycode);
+            *down &= ~mask;
+        }
+    }
+    macro_stop();
+}
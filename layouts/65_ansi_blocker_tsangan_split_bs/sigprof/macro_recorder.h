@@ -0,0 +1,42 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Playback rates (stored in `user_config.macro_rate`).
+enum macro_rates {
+    MACRO_RATE_BATCH,    // all events at once, as fast as the host accepts them
+    MACRO_RATE_FAST,     // 1/4 of the recorded delays
+    MACRO_RATE_HALF,     // 1/2 of the recorded delays
+    MACRO_RATE_RECORDED, // the recorded delays
+    MACRO_RATE_COUNT,
+};
+
+// Start recording a macro into the specified slot (stops any current
+// recording or playback).
+void macro_record_start(uint8_t slot);
+
+// Stop recording; the recorded macro is written to EEPROM later by
+// macro_task(), when the keyboard is idle.
+void macro_record_stop(void);
+
+// Return true if a macro is being recorded.
+bool macro_is_recording(void);
+
+// Return true if a macro is being played.
+bool macro_is_playing(void);
+
+// Record the key event if a macro is being recorded.
+void macro_record_event(uint16_t keycode, keyrecord_t *record);
+
+// Start playing the macro from the specified slot.
+void macro_play(uint8_t slot);
+
+// Stop recording or playback.
+void macro_stop(void);
+
+// Play the pending macro events and write the recorded macro to EEPROM when
+// the keyboard is idle (must be called from the housekeeping task).
+void macro_task(void);
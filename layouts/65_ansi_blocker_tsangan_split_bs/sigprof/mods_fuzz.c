@@ -0,0 +1,186 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Optional on-device fuzzer for the modifier handling (enabled by
+// `MODS_FUZZ_ENABLE = yes`).  The Shift tap dances, the mod-tap-action keys
+// and the tap dance tables register and unregister modifiers in several
+// places, and a bug in any of them results in a stuck modifier; instead of
+// hiding such bugs at runtime, the fuzzer is used to find them.
+//
+// A run injects MODS_FUZZ_EVENTS random press and release events for the
+// selected keys through action_exec(), with random delays of up to
+// MODS_FUZZ_MAX_DELAY ms between them, so that the events go through the whole
+// QMK key processing (layers, tap dances, mod-tap-action keys).  Then all keys
+// which remained pressed are released, and after MODS_FUZZ_SETTLE_TIME ms
+// (which must be longer than any tapping term and the one shot timeout) the
+// keyboard state is checked: no modifiers (normal, weak or non-locked one
+// shot) may remain active, and the layer state must be the same as before the
+// run.  The result is printed to the debug console together with the random
+// seed (MODS_FUZZ_SEED may be defined to repeat a run with the same seed).  The
+// run is aborted if any real input activity happens.
+//
+// The injected events are sent to the host, therefore the fuzzer must be
+// started only when the modifier keys cannot do any harm.
+
+#include "mods_fuzz.h"
+#include "print.h"
+
+#ifndef MODS_FUZZ_EVENTS
+#    define MODS_FUZZ_EVENTS 200
+#endif
+
+#ifndef MODS_FUZZ_MAX_DELAY
+#    define MODS_FUZZ_MAX_DELAY 255
+#endif
+
+#ifndef MODS_FUZZ_START_DELAY
+#    define MODS_FUZZ_START_DELAY 1000
+#endif
+
+#ifndef MODS_FUZZ_SETTLE_TIME
+#    define MODS_FUZZ_SETTLE_TIME 3000
+#endif
+
+#define MODS_FUZZ_MAX_KEYS 8
+
+enum mods_fuzz_states {
+    MODS_FUZZ_IDLE,
+    MODS_FUZZ_ARMED,
+    MODS_FUZZ_RUNNING,
+    MODS_FUZZ_SETTLING,
+};
+
+static uint8_t         fuzz_state;
+static const keypos_t *fuzz_keys;
+static uint8_t         fuzz_key_count;
+static uint8_t         fuzz_keys_down; // bitmap of the pressed keys
+static uint16_t        fuzz_events;    // number of injected events
+static uint16_t        fuzz_delay;     // delay before the next event
+static uint16_t        fuzz_time;      // time of the last event
+static uint32_t        fuzz_start;     // time when the run was started
+static layer_state_t   fuzz_layers;    // layer state when the run was started
+static uint32_t        fuzz_seed;
+static uint32_t        fuzz_rng;
+
+// xorshift32 (the state must not be 0).
+static uint32_t fuzz_random(void) {
+    fuzz_rng ^= fuzz_rng << 13;
+    fuzz_rng ^= fuzz_rng >> 17;
+    fuzz_rng ^= fuzz_rng << 5;
+    return fuzz_rng;
+}
+
+static void inject_event(uint8_t index, bool pressed) {
+    keypos_t key = fuzz_keys[index];
+    action_exec(MAKE_KEYEVENT(key.row, key.col, pressed));
+    if (pressed) {
+        fuzz_keys_down |= 1 << index;
+    } else {
+        fuzz_keys_down &= ~(1 << index);
+    }
+    fuzz_time = timer_read();
+}
+
+static void release_all(void) {
+    for (uint8_t i = 0; i < fuzz_key_count; ++i) {
+        if (fuzz_keys_down & (1 << i)) {
+            inject_event(i, false);
+        }
+    }
+}
+
+static bool matrix_is_released(void) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        if (matrix_get_row(row) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_result(void) {
+    uint8_t       mods         = get_mods();
+    uint8_t       weak_mods    = get_weak_mods();
+    uint8_t       oneshot_mods = get_oneshot_mods() & ~get_oneshot_locked_mods();
+    layer_state_t layers       = layer_state;
+
+    if (mods == 0 && weak_mods == 0 && oneshot_mods == 0 && layers == fuzz_layers) {
+        dprintf("mods fuzz %08lX: ok\n", (unsigned long)fuzz_seed);
+    } else {
+        dprintf("mods fuzz %08lX: FAIL mods %02X weak %02X oneshot %02X layers %08lX\n", (unsigned long)fuzz_seed, mods, weak_mods, oneshot_mods, (unsigned long)layers);
+    }
+}
+
+void mods_fuzz_start(const keypos_t *keys, uint8_t count) {
+    if (fuzz_state != MODS_FUZZ_IDLE || count == 0) {
+        return;
+    }
+    fuzz_keys      = keys;
+    fuzz_key_count = count < MODS_FUZZ_MAX_KEYS ? count : MODS_FUZZ_MAX_KEYS;
+    fuzz_state     = MODS_FUZZ_ARMED;
+}
+
+bool mods_fuzz_is_running(void) {
+    return fuzz_state != MODS_FUZZ_IDLE;
+}
+
+void mods_fuzz_task(void) {
+    switch (fuzz_state) {
+        case MODS_FUZZ_IDLE:
+            return;
+
+        case MODS_FUZZ_ARMED:
+            if (last_input_activity_elapsed() < MODS_FUZZ_START_DELAY || !matrix_is_released()) {
+                return;
+            }
+#ifdef MODS_FUZZ_SEED
+            fuzz_seed = MODS_FUZZ_SEED;
+#else
+            fuzz_seed = timer_read32() ^ 0x9e3779b9;
+#endif
+            fuzz_rng       = fuzz_seed ? fuzz_seed : 1;
+            fuzz_keys_down = 0;
+            fuzz_events    = 0;
+            fuzz_delay     = 0;
+            fuzz_time      = timer_read();
+            fuzz_start     = timer_read32();
+            fuzz_layers    = layer_state;
+            fuzz_state     = MODS_FUZZ_RUNNING;
+            dprintf("mods fuzz %08lX: start\n", (unsigned long)fuzz_seed);
+            return;
+
+        default:
+            break;
+    }
+
+    // The injected events are not seen as input activity, therefore any input
+    // activity after the start is a real key event.
+    if (last_input_activity_elapsed() < timer_elapsed32(fuzz_start)) {
+        release_all();
+        fuzz_state = MODS_FUZZ_IDLE;
+        dprintf("mods fuzz %08lX: aborted\n", (unsigned long)fuzz_seed);
+        return;
+    }
+
+    if (fuzz_state == MODS_FUZZ_RUNNING) {
+        if (timer_elapsed(fuzz_time) < fuzz_delay) {
+            return;
+        }
+        if (fuzz_events < MODS_FUZZ_EVENTS) {
+            uint32_t random = fuzz_random();
+            uint8_t  index  = (random & 0xff) % fuzz_key_count;
+            inject_event(index, !(fuzz_keys_down & (1 << index)));
+            fuzz_delay = (random >> 8) % (MODS_FUZZ_MAX_DELAY + 1);
+            ++fuzz_events;
+            return;
+        }
+        release_all();
+        fuzz_state = MODS_FUZZ_SETTLING;
+        return;
+    }
+
+    if (timer_elapsed(fuzz_time) >= MODS_FUZZ_SETTLE_TIME) {
+        check_result();
+        fuzz_state = MODS_FUZZ_IDLE;
+    }
+}
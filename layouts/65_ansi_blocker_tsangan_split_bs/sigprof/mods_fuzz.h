@@ -0,0 +1,19 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Arm the fuzzer for the specified keys; the run starts when all keys are
+// released and there was no input activity for MODS_FUZZ_START_DELAY ms.
+// The `keys[]` array must stay valid until the run is finished.
+void mods_fuzz_start(const keypos_t *keys, uint8_t count);
+
+// Return true if the fuzzer is armed or running (the injected key events
+// should not be counted as real input).
+bool mods_fuzz_is_running(void);
+
+// Inject the pending key events and check the results (must be called from
+// the housekeeping task).
+void mods_fuzz_task(void);
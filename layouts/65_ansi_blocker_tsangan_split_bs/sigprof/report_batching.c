@@ -0,0 +1,124 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Optional keyboard report batching (enabled by `REPORT_BATCHING_ENABLE = yes`).
+// The host driver is wrapped so that keyboard reports produced during one
+// main loop iteration are merged into a single report, which is sent by
+// report_batching_task() at the end of the iteration.  Reports are full state
+// snapshots, so merging just replaces the pending report; however, the pending
+// report is sent first if merging would hide a state change from the host:
+// - a key or modifier which was added in the pending report would be removed
+//   again (or the other way around), e.g., a tap performed by tap_code();
+// - the modifiers would change after keys were added in the pending report
+//   (the host would apply the new modifiers to those keys).
+// Batching is done only for the 6KRO keyboard report.  The `send_nkro`,
+// `send_mouse` and `send_extra` driver calls are also wrapped, but only to
+// send the pending 6KRO report first, so that the reports reach the host in
+// order (e.g., Ctrl must be seen by the host before a mouse click in the same
+// iteration); NKRO reports and reports other than the keyboard report are not
+// batched.
+
+#include "report_batching.h"
+#include "host.h"
+#include "host_driver.h"
+
+static host_driver_t     batching_driver;
+static host_driver_t    *host_driver;    // the wrapped driver
+static report_keyboard_t sent_report;    // the last report sent to the host
+static report_keyboard_t pending_report; // the merged report which was not sent yet
+static bool              report_pending;
+
+static bool has_key(const report_keyboard_t *report, uint8_t key) {
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        if (report->keys[i] == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return true if the pending report adds any keys to the sent report.
+static bool pending_adds_keys(void) {
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        if (pending_report.keys[i] != KC_NO && !has_key(&sent_report, pending_report.keys[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return true if replacing the pending report with `next` would hide some
+// state change in the pending report from the host.
+static bool merge_loses_changes(const report_keyboard_t *next) {
+    if ((pending_report.mods & ~sent_report.mods & ~next->mods) || (sent_report.mods & ~pending_report.mods & next->mods)) {
+        return true;
+    }
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        uint8_t added = pending_report.keys[i];
+        if (added != KC_NO && !has_key(&sent_report, added) && !has_key(next, added)) {
+            return true;
+        }
+        uint8_t removed = sent_report.keys[i];
+        if (removed != KC_NO && !has_key(&pending_report, removed) && has_key(next, removed)) {
+            return true;
+        }
+    }
+    return next->mods != pending_report.mods && pending_adds_keys();
+}
+
+static void send_pending_report(void) {
+    if (report_pending) {
+        report_pending = false;
+        host_driver->send_keyboard(&pending_report);
+        memcpy(&sent_report, &pending_report, sizeof(sent_report));
+    }
+}
+
+static void batching_send_keyboard(report_keyboard_t *report) {
+    if (report_pending && merge_loses_changes(report)) {
+        send_pending_report();
+    }
+    memcpy(&pending_report, report, sizeof(pending_report));
+    report_pending = true;
+}
+
+void report_batching_flush(void) {
+    send_pending_report();
+}
+
+#ifdef NKRO_ENABLE
+static void batching_send_nkro(report_nkro_t *report) {
+    send_pending_report();
+    host_driver->send_nkro(report);
+}
+#endif
+
+static void batching_send_mouse(report_mouse_t *report) {
+    send_pending_report();
+    host_driver->send_mouse(report);
+}
+
+static void batching_send_extra(report_extra_t *report) {
+    send_pending_report();
+    host_driver->send_extra(report);
+}
+
+void report_batching_task(void) {
+    host_driver_t *driver = host_get_driver();
+
+    // The driver may be set (or replaced) by the protocol code after the
+    // keyboard initialization, therefore it is wrapped here.
+    if (driver != NULL && driver != &batching_driver) {
+        send_pending_report();
+        host_driver                   = driver;
+        batching_driver               = *driver;
+        batching_driver.send_keyboard = batching_send_keyboard;
+        batching_driver.send_mouse    = batching_send_mouse;
+        batching_driver.send_extra    = batching_send_extra;
+#ifdef NKRO_ENABLE
+        batching_driver.send_nkro = batching_send_nkro;
+#endif
+        host_set_driver(&batching_driver);
+    }
+    send_pending_report();
+}
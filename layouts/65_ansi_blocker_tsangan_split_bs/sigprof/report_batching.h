@@ -0,0 +1,14 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Install the batching host driver if needed and send the pending keyboard
+// report (must be called at the end of the housekeeping task).
+void report_batching_task(void);
+
+// Send the pending keyboard report immediately (must be called before waiting
+// if the host must see the state before the wait, e.g., for a timed tap).
+void report_batching_flush(void);
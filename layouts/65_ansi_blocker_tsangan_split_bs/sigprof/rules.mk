@@ -1,4 +1,47 @@
-DYNAMIC_MACRO_ENABLE = yes
 TAP_DANCE_ENABLE = yes
+COMBO_ENABLE = yes
 KEYBOARD_SHARED_EP = yes
-DEBOUNCE_TYPE = asym_eager_defer_pk
+# RAW_ENABLE = yes adds the raw HID protocol for the key statistics, the user
+# settings and the keymap overrides (see `raw_hid_receive()` in keymap.c); it
+# is not enabled by default, because any host program can use it to change
+# the keymap.
+DEBOUNCE_TYPE = custom
+
+SRC += adaptive_debounce.c
+SRC += user_settings.c
+SRC += macro_recorder.c
+SRC += keymap_overrides.c
+SRC += idle_power.c
+
+# The event trace is drained to the console and/or over raw HID.
+ifneq ($(filter yes,$(strip $(CONSOLE_ENABLE)) $(strip $(RAW_ENABLE))),)
+    SRC += event_trace.c
+    OPT_DEFS += -DEVENT_TRACE_ENABLE
+endif
+
+LATENCY_STATS_ENABLE ?= no
+ifeq ($(strip $(LATENCY_STATS_ENABLE)), yes)
+    SRC += latency_stats.c
+    OPT_DEFS += -DLATENCY_STATS_ENABLE
+endif
+
+KEY_STATS_ENABLE ?= no
+ifeq ($(strip $(KEY_STATS_ENABLE)), yes)
+    SRC += key_stats.c
+    OPT_DEFS += -DKEY_STATS_ENABLE
+endif
+
+# On-device modifier fuzzer (see mods_fuzz.c; needs CONSOLE_ENABLE = yes to
+# report the results).  Only for checking the behaviour with the real QMK core;
+# the regular checks are done by the host fuzzer (tests/fuzz_mods.c).
+MODS_FUZZ_ENABLE ?= no
+ifeq ($(strip $(MODS_FUZZ_ENABLE)), yes)
+    SRC += mods_fuzz.c
+    OPT_DEFS += -DMODS_FUZZ_ENABLE
+endif
+
+REPORT_BATCHING_ENABLE ?= no
+ifeq ($(strip $(REPORT_BATCHING_ENABLE)), yes)
+    SRC += report_batching.c
+    OPT_DEFS += -DREPORT_BATCHING_ENABLE
+endif
@@ -0,0 +1,142 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Settings store in the EEPROM user datablock.  The datablock is split into
+// USER_SETTINGS_SLOT_COUNT slots of USER_SETTINGS_SLOT_SIZE bytes; every write
+// goes to the slot after the one which was written last, so that EEPROM wear
+// is spread over all slots.  Every slot has a header with the format version,
+// a sequence number (the valid slot with the newest sequence number is used)
+// and a checksum (the header is written after the data, therefore a slot which
+// was not written completely is ignored).
+//
+// Changes are not written immediately; user_settings_save() just marks the
+// settings as dirty, and user_settings_task() writes them when there was no
+// input activity for USER_SETTINGS_FLUSH_DELAY ms.
+
+#include "user_settings.h"
+#include "eeconfig.h"
+#include "eeprom.h"
+
+#define USER_SETTINGS_VERSION 1
+
+#ifndef USER_SETTINGS_FLUSH_DELAY
+#    define USER_SETTINGS_FLUSH_DELAY 3000
+#endif
+
+typedef struct {
+    uint8_t  version;
+    uint8_t  sequence;
+    uint16_t checksum;
+} user_settings_header_t;
+
+typedef struct {
+    user_settings_header_t header;
+    union {
+        user_config_t config;
+        uint8_t       data[USER_SETTINGS_SLOT_SIZE - sizeof(user_settings_header_t)];
+    };
+} user_settings_slot_t;
+
+_Static_assert(sizeof(user_config_t) <= USER_SETTINGS_SLOT_SIZE - sizeof(user_settings_header_t), "user_config_t does not fit into USER_SETTINGS_SLOT_SIZE");
+_Static_assert(sizeof(user_settings_slot_t) == USER_SETTINGS_SLOT_SIZE, "Unexpected user_settings_slot_t size");
+_Static_assert(USER_SETTINGS_SLOT_SIZE * USER_SETTINGS_SLOT_COUNT <= EECONFIG_USER_DATA_SIZE, "EECONFIG_USER_DATA_SIZE is too small for the settings slots");
+
+// The whole user datablock (with all other EEPROM data) must fit into the
+// EEPROM of the actual MCU (TOTAL_EEPROM_BYTE_COUNT is defined by eeprom.h for
+// every EEPROM driver).
+#if !defined(TOTAL_EEPROM_BYTE_COUNT) && defined(E2END)
+#    define TOTAL_EEPROM_BYTE_COUNT (E2END + 1)
+#endif
+#ifndef TOTAL_EEPROM_BYTE_COUNT
+#    error "TOTAL_EEPROM_BYTE_COUNT is not defined, the EEPROM size cannot be checked"
+#endif
+_Static_assert(EECONFIG_SIZE <= TOTAL_EEPROM_BYTE_COUNT, "The EEPROM is too small for EECONFIG_USER_DATA_SIZE");
+
+// Settings format used before the settings store was added: a single 32-bit
+// word with the language switch mode in the lower bits.
+typedef union {
+    uint32_t raw;
+    struct {
+        uint32_t lang_switch_mode : 3;
+    };
+} legacy_user_config_t;
+
+user_config_t user_config;
+
+static uint8_t user_settings_slot;
+static uint8_t user_settings_sequence;
+static bool    user_settings_dirty;
+
+// Offset of the slot in the user datablock.
+static uint16_t slot_offset(uint8_t slot) {
+    return (uint16_t)slot * USER_SETTINGS_SLOT_SIZE;
+}
+
+// Fletcher-16 checksum of the slot data, the version and the sequence number.
+static uint16_t slot_checksum(const user_settings_slot_t *slot) {
+    uint16_t sum1 = slot->header.version;
+    uint16_t sum2 = sum1;
+
+    sum1 = (sum1 + slot->header.sequence) % 255;
+    sum2 = (sum2 + sum1) % 255;
+    for (uint16_t i = 0; i < sizeof(slot->data); ++i) {
+        sum1 = (sum1 + slot->data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+}
+
+void user_settings_init(void) {
+    bool found = false;
+
+    if (eeconfig_is_user_datablock_valid()) {
+        for (uint8_t i = 0; i < USER_SETTINGS_SLOT_COUNT; ++i) {
+            user_settings_slot_t slot;
+            eeconfig_read_user_datablock(&slot, slot_offset(i), sizeof(slot));
+            if (slot.header.version == 0 || slot.header.version > USER_SETTINGS_VERSION || slot.header.checksum != slot_checksum(&slot)) {
+                continue;
+            }
+            if (found && (int8_t)(slot.header.sequence - user_settings_sequence) <= 0) {
+                continue;
+            }
+            memcpy(&user_config, &slot.config, sizeof(user_config));
+            user_settings_slot     = i;
+            user_settings_sequence = slot.header.sequence;
+            found                  = true;
+        }
+    } else {
+        eeconfig_init_user_datablock();
+    }
+
+    if (!found) {
+        legacy_user_config_t legacy = {.raw = eeconfig_read_user()};
+
+        memset(&user_config, 0, sizeof(user_config));
+        user_config.lang_switch_mode = legacy.lang_switch_mode;
+        user_settings_slot           = USER_SETTINGS_SLOT_COUNT - 1;
+        user_settings_save();
+    }
+}
+
+void user_settings_save(void) {
+    user_settings_dirty = true;
+}
+
+void user_settings_task(void) {
+    if (!user_settings_dirty || last_input_activity_elapsed() < USER_SETTINGS_FLUSH_DELAY) {
+        return;
+    }
+
+    user_settings_slot_t slot;
+    memset(&slot, 0, sizeof(slot));
+    memcpy(&slot.config, &user_config, sizeof(user_config));
+    slot.header.version  = USER_SETTINGS_VERSION;
+    slot.header.sequence = ++user_settings_sequence;
+    slot.header.checksum = slot_checksum(&slot);
+
+    user_settings_slot = (user_settings_slot + 1) % USER_SETTINGS_SLOT_COUNT;
+    uint16_t offset    = slot_offset(user_settings_slot);
+    eeconfig_update_user_datablock(&slot.data, offset + sizeof(slot.header), sizeof(slot.data));
+    eeconfig_update_user_datablock(&slot.header, offset, sizeof(slot.header));
+    user_settings_dirty = false;
+}
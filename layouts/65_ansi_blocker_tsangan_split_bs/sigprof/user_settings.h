@@ -0,0 +1,37 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "quantum.h"
+
+// Number of keys with adjustable tapping terms (see `tapping_term_keycodes[]`
+// in keymap.c).
+#define TAPPING_TERM_KEY_COUNT 6
+
+// Persistent user settings.  New fields must be added at the end (and
+// USER_SETTINGS_VERSION must be incremented if the new fields need a default
+// value other than 0).
+typedef struct {
+    uint8_t  lang_switch_mode;
+    uint8_t  chatter_count[MATRIX_ROWS][MATRIX_COLS];
+    uint16_t tapping_term[TAPPING_TERM_KEY_COUNT];
+    uint8_t  macro_rate;   // see `enum macro_rates` in macro_recorder.h
+    uint8_t  idle_timeout; // minutes (0 = IDLE_TIMEOUT_DEFAULT), see idle_power.c
+} user_config_t;
+
+// Value of `user_config.idle_timeout` which disables the idle mode.
+#define IDLE_TIMEOUT_NEVER UINT8_MAX
+
+extern user_config_t user_config;
+
+// Load the settings from EEPROM (converting them from older formats if
+// needed).
+void user_settings_init(void);
+
+// Mark the settings as changed; they will be written to EEPROM later, when
+// the keyboard is idle.
+void user_settings_save(void);
+
+// Write the changed settings to EEPROM if the keyboard is idle.
+void user_settings_task(void);
@@ -0,0 +1,261 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Fuzzer for the modifier handling: random bursts of presses and releases of
+// the modifier keys (the Shift tap dances, TD_RCTL, U_RALTG and the plain
+// modifiers) mixed with U_FESC and J, with random delays around the tapping
+// term.  After every burst all keys are released and the keyboard is left to
+// settle, then the following is checked:
+// - no keys, modifiers or layers are left active, and nothing is pending in
+//   the core (tapping, tap dances, combos);
+// - the language switch chord (Ctrl+F15) was sent only for clean double taps
+//   of a Shift key, and for every double tap which is clean with a safe
+//   timing margin.
+//
+// A double tap of a Shift key is clean if there were no presses of other keys
+// between its events; at most one language switch may be sent for every such
+// double tap.  It is also certain to send the switch if there were no other
+// events at all between its events, it was not preceded by a press of the same
+// key less than the tapping term earlier (which would make it a triple tap),
+// and all intervals are at least DOUBLE_TAP_MARGIN ms away from the tapping
+// term.
+//
+// Usage:
+//     fuzz_mods [--seed <seed>] [--bursts <count>]
+//
+// A failing burst is printed as a trace for replay.c.
+
+#include "keymap_test.h"
+
+#define DEFAULT_SEED 1
+#define DEFAULT_BURSTS 2000
+#define MAX_BURST_EVENTS 64
+#define MAX_DELAY (TAPPING_TERM * 2)
+#define DOUBLE_TAP_MARGIN 10
+
+typedef struct {
+    uint32_t time;
+    uint8_t  position;
+    bool     pressed;
+} fuzz_event_t;
+
+static const struct {
+    const char *name;
+    uint8_t     position;
+} fuzz_keys[] = {
+    {"LSFT", LP_LSFT}, {"RSFT", LP_RSFT}, {"RCTL", LP_RCTL}, {"RALT", LP_RALT}, {"LCTL", LP_LCTL},
+    {"LGUI", LP_LGUI}, {"LALT", LP_LALT}, {"ESC", LP_ESC},   {"J", LP_J},
+};
+
+static fuzz_event_t events[MAX_BURST_EVENTS + ARRAY_SIZE(fuzz_keys)];
+static uint32_t     event_count;
+static bool         key_down[ARRAY_SIZE(fuzz_keys)];
+static uint32_t     rng_state;
+static uint32_t     total_switches;
+static uint32_t     total_certain;
+
+// xorshift32 (the same sequence on every host for the same seed).
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t random_delay(void) {
+    // Mostly short delays, so that multiple taps are frequent.
+    return (rng() % 4 == 0) ? rng() % (MAX_DELAY + 1) : rng() % (TAPPING_TERM / 2);
+}
+
+static void add_event(uint8_t index, bool pressed) {
+    events[event_count].time     = sim_now();
+    events[event_count].position = index;
+    events[event_count].pressed  = pressed;
+    ++event_count;
+    key_down[index] = pressed;
+    sim_key(key_at(fuzz_keys[index].position), pressed);
+}
+
+static bool is_shift(uint8_t index) {
+    return fuzz_keys[index].position == LP_LSFT || fuzz_keys[index].position == LP_RSFT;
+}
+
+static uint32_t interval(uint32_t from, uint32_t to) {
+    return events[to].time - events[from].time;
+}
+
+static bool near_term(uint32_t ms) {
+    return ms + DOUBLE_TAP_MARGIN > TAPPING_TERM && ms < TAPPING_TERM + DOUBLE_TAP_MARGIN;
+}
+
+// Count the clean double taps of the Shift keys in the burst (`certain` gets
+// the number of double taps which must send the language switch).
+static uint32_t count_double_taps(uint32_t *certain) {
+    uint32_t possible = 0;
+
+    *certain = 0;
+    for (uint32_t i = 0; i + 3 < event_count; ++i) {
+        uint8_t key = events[i].position;
+        if (!is_shift(key) || !events[i].pressed) {
+            continue;
+        }
+
+        // Find the next three events of this key and check that they are the
+        // release, press and release; note any other events between them.
+        uint32_t taps[4]      = {i};
+        uint32_t found        = 1;
+        bool     other_press  = false;
+        bool     other_events = false;
+        for (uint32_t j = i + 1; j < event_count && found < 4; ++j) {
+            if (events[j].position == key) {
+                taps[found++] = j;
+            } else {
+                other_events = true;
+                other_press |= events[j].pressed;
+            }
+        }
+        if (found < 4 || other_press || events[taps[1]].pressed || !events[taps[2]].pressed || events[taps[3]].pressed) {
+            continue;
+        }
+        ++possible;
+        if (other_events) {
+            continue;
+        }
+
+        // The previous press of this key must not continue the tap count, and
+        // the next one must not extend the double tap.
+        bool     certain_tap = true;
+        uint32_t prev_press  = UINT32_MAX;
+        uint32_t next_press  = UINT32_MAX;
+        for (uint32_t j = i; j-- > 0;) {
+            if (events[j].pressed) {
+                prev_press = events[j].position == key ? j : UINT32_MAX;
+                break;
+            }
+        }
+        for (uint32_t j = taps[3] + 1; j < event_count; ++j) {
+            if (events[j].pressed) {
+                next_press = events[j].position == key ? j : UINT32_MAX;
+                break;
+            }
+        }
+        if (prev_press != UINT32_MAX && interval(prev_press, i) < TAPPING_TERM + DOUBLE_TAP_MARGIN) {
+            certain_tap = false;
+        }
+        if (next_press != UINT32_MAX && interval(taps[2], next_press) < TAPPING_TERM + DOUBLE_TAP_MARGIN) {
+            certain_tap = false;
+        }
+        if (near_term(interval(taps[0], taps[2])) || interval(taps[0], taps[2]) > TAPPING_TERM || near_term(interval(taps[2], taps[3])) || interval(taps[2], taps[3]) > TAPPING_TERM) {
+            certain_tap = false;
+        }
+        if (certain_tap) {
+            ++*certain;
+        }
+    }
+    return possible;
+}
+
+// Return true if every F15 press starting from the report index `start` was
+// sent together with Left Ctrl (other held modifiers may be added).
+static bool switches_have_ctrl(uint32_t start) {
+    bool down = false;
+    for (uint32_t i = start; i < sim_report_count; ++i) {
+        if (sim_reports[i].type != SIM_REPORT_KEYBOARD) {
+            continue;
+        }
+        bool f15 = memchr(sim_reports[i].keys, KC_F15, KEYBOARD_REPORT_KEYS) != NULL;
+        if (f15 && !down && !(sim_reports[i].mods & MOD_BIT(KC_LCTL))) {
+            return false;
+        }
+        down = f15;
+    }
+    return true;
+}
+
+static void print_burst(uint32_t burst, uint32_t seed) {
+    printf("# burst %u, seed %u\n", (unsigned)burst, (unsigned)seed);
+    for (uint32_t i = 0; i < event_count; ++i) {
+        printf("%u %s %c\n", (unsigned)(events[i].time - events[0].time), fuzz_keys[events[i].position].name, events[i].pressed ? 'd' : 'u');
+    }
+}
+
+static bool run_burst(uint32_t burst, uint32_t seed) {
+    uint32_t start        = sim_report_count;
+    uint32_t burst_events = 1 + rng() % MAX_BURST_EVENTS;
+
+    event_count = 0;
+    while (event_count < burst_events) {
+        uint8_t index = rng() % ARRAY_SIZE(fuzz_keys);
+        if (rng() % 3 == 0 && !key_down[index] && is_shift(index) && event_count + 4 <= burst_events) {
+            // An explicit double tap with random timing.
+            for (uint8_t k = 0; k < 4; ++k) {
+                add_event(index, k % 2 == 0);
+                sim_advance(rng() % (TAPPING_TERM + TAPPING_TERM / 2));
+            }
+            continue;
+        }
+        add_event(index, !key_down[index]);
+        sim_advance(random_delay());
+    }
+    for (uint8_t index = 0; index < ARRAY_SIZE(fuzz_keys); ++index) {
+        if (key_down[index]) {
+            add_event(index, false);
+            sim_advance(random_delay());
+        }
+    }
+    settle();
+
+    bool     ok = true;
+    uint32_t certain;
+    uint32_t possible = count_double_taps(&certain);
+    uint32_t switches = sim_host_presses(start, KC_F15);
+    total_switches += switches;
+    total_certain += certain;
+    if (!sim_host_idle() || sim_real_mods() || sim_weak_mods() || layer_state || sim_core_pending()) {
+        printf("FAIL: keys, modifiers or layers are left active (host mods %02X, real mods %02X, weak mods %02X, layers %08lX)\n", sim_host_mods(), sim_real_mods(), sim_weak_mods(), (unsigned long)layer_state);
+        ok = false;
+    }
+    if (switches > possible || switches < certain) {
+        printf("FAIL: %u language switches for %u clean double taps (%u certain)\n", (unsigned)switches, (unsigned)possible, (unsigned)certain);
+        ok = false;
+    }
+    if (!switches_have_ctrl(start)) {
+        printf("FAIL: language switch sent without Left Ctrl\n");
+        ok = false;
+    }
+    if (!ok) {
+        print_burst(burst, seed);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t seed   = DEFAULT_SEED;
+    uint32_t bursts = DEFAULT_BURSTS;
+
+    for (int arg = 1; arg < argc; arg += 2) {
+        if (arg + 1 < argc && strcmp(argv[arg], "--seed") == 0) {
+            seed = strtoul(argv[arg + 1], NULL, 0);
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--bursts") == 0) {
+            bursts = strtoul(argv[arg + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [--seed <seed>] [--bursts <count>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    rng_state = seed ? seed : DEFAULT_SEED;
+    sim_eeprom_clear();
+    sim_init();
+    user_config.lang_switch_mode = LSW_MODE_CTRL_F15;
+
+    uint32_t failed = 0;
+    uint32_t total  = 0;
+    for (uint32_t burst = 0; burst < bursts && failed < 5; ++burst) {
+        failed += !run_burst(burst, seed);
+        total += event_count;
+        sim_reports_clear();
+    }
+    printf("fuzz_mods: seed %u, %u bursts, %u events, %u language switches (%u certain), %u failed\n", (unsigned)seed, (unsigned)bursts, (unsigned)total, (unsigned)total_switches, (unsigned)total_certain, (unsigned)failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,585 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Subset of the QMK API used by the keymap, for the native test build.  The
+// keycode ranges, the types and the function signatures follow QMK 0.22; the
+// functions are implemented by the model of the QMK core in sim.c.  Values of
+// the quantum keycodes which the model does not handle (lighting, NKRO, etc.)
+// are not the real ones.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef MATRIX_ROWS
+#    define MATRIX_ROWS 5
+#endif
+#ifndef MATRIX_COLS
+#    define MATRIX_COLS 16
+#endif
+
+#ifndef TAPPING_TERM
+#    define TAPPING_TERM 200
+#endif
+#ifndef TAP_CODE_DELAY
+#    define TAP_CODE_DELAY 0
+#endif
+#ifndef TAP_HOLD_CAPS_DELAY
+#    define TAP_HOLD_CAPS_DELAY 80
+#endif
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+// progmem.h
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_ptr(address) (*(void *const *)(address))
+#define memcpy_P(dest, src, size) memcpy((dest), (src), (size))
+
+// matrix.h, keyboard.h, action.h
+typedef uint16_t matrix_row_t;
+typedef uint32_t layer_state_t;
+
+typedef struct {
+    uint8_t col;
+    uint8_t row;
+} keypos_t;
+
+typedef enum {
+    TICK_EVENT = 0,
+    KEY_EVENT  = 1,
+    COMBO_EVENT,
+} keyevent_type_t;
+
+typedef struct {
+    keypos_t        key;
+    uint16_t        time;
+    keyevent_type_t type;
+    bool            pressed;
+} keyevent_t;
+
+typedef struct {
+    bool    interrupted : 1;
+    bool    reserved2 : 1;
+    bool    reserved1 : 1;
+    bool    reserved0 : 1;
+    uint8_t count : 4;
+} tap_t;
+
+typedef struct {
+    keyevent_t event;
+    tap_t      tap;
+    uint16_t   keycode; // set for the combo events
+} keyrecord_t;
+
+matrix_row_t matrix_get_row(uint8_t row);
+
+// timer.h, wait.h
+typedef uint32_t fast_timer_t;
+
+#define TIMER_DIFF_16(a, b) ((uint16_t)((a) - (b)))
+#define TIMER_DIFF_32(a, b) ((uint32_t)((a) - (b)))
+#define TIMER_DIFF_FAST(a, b) TIMER_DIFF_32(a, b)
+
+uint16_t     timer_read(void);
+uint32_t     timer_read32(void);
+uint16_t     timer_elapsed(uint16_t last);
+uint32_t     timer_elapsed32(uint32_t last);
+fast_timer_t timer_read_fast(void);
+void         wait_ms(uint32_t ms);
+
+uint32_t last_input_activity_elapsed(void);
+uint32_t last_matrix_activity_elapsed(void);
+
+// keycodes.h (basic keycodes)
+enum qk_keycode_defines {
+    KC_NO   = 0x0000,
+    KC_TRNS = 0x0001,
+    KC_A    = 0x0004,
+    KC_B,
+    KC_C,
+    KC_D,
+    KC_E,
+    KC_F,
+    KC_G,
+    KC_H,
+    KC_I,
+    KC_J,
+    KC_K,
+    KC_L,
+    KC_M,
+    KC_N,
+    KC_O,
+    KC_P,
+    KC_Q,
+    KC_R,
+    KC_S,
+    KC_T,
+    KC_U,
+    KC_V,
+    KC_W,
+    KC_X,
+    KC_Y,
+    KC_Z,
+    KC_1,
+    KC_2,
+    KC_3,
+    KC_4,
+    KC_5,
+    KC_6,
+    KC_7,
+    KC_8,
+    KC_9,
+    KC_0,
+    KC_ENT,
+    KC_ESC,
+    KC_BSPC,
+    KC_TAB,
+    KC_SPC,
+    KC_MINS,
+    KC_EQL,
+    KC_LBRC,
+    KC_RBRC,
+    KC_BSLS,
+    KC_NUHS,
+    KC_SCLN,
+    KC_QUOT,
+    KC_GRV,
+    KC_COMM,
+    KC_DOT,
+    KC_SLSH,
+    KC_CAPS,
+    KC_F1,
+    KC_F2,
+    KC_F3,
+    KC_F4,
+    KC_F5,
+    KC_F6,
+    KC_F7,
+    KC_F8,
+    KC_F9,
+    KC_F10,
+    KC_F11,
+    KC_F12,
+    KC_PSCR,
+    KC_SCRL,
+    KC_PAUS,
+    KC_INS,
+    KC_HOME,
+    KC_PGUP,
+    KC_DEL,
+    KC_END,
+    KC_PGDN,
+    KC_RGHT,
+    KC_LEFT,
+    KC_DOWN,
+    KC_UP,
+    KC_NUM,
+    KC_PSLS,
+    KC_PAST,
+    KC_PMNS,
+    KC_PPLS,
+    KC_PENT,
+    KC_P1,
+    KC_P2,
+    KC_P3,
+    KC_P4,
+    KC_P5,
+    KC_P6,
+    KC_P7,
+    KC_P8,
+    KC_P9,
+    KC_P0,
+    KC_PDOT,
+    KC_NUBS,
+    KC_APP,
+    KC_KB_POWER,
+    KC_PEQL,
+    KC_F13,
+    KC_F14,
+    KC_F15,
+    KC_F16,
+    KC_F17,
+    KC_F18,
+    KC_F19,
+    KC_F20,
+    KC_F21,
+    KC_F22,
+    KC_F23,
+    KC_F24,
+    KC_PCMM = 0x0085,
+
+    KC_PWR  = 0x00A5, // system control
+    KC_SLEP = 0x00A6,
+    KC_WAKE = 0x00A7,
+    KC_MUTE = 0x00A8, // consumer control
+    KC_VOLU = 0x00A9,
+    KC_VOLD = 0x00AA,
+
+    KC_MS_U = 0x00CD, // mouse keys
+    KC_MS_D,
+    KC_MS_L,
+    KC_MS_R,
+    KC_BTN1,
+    KC_BTN2,
+    KC_BTN3,
+    KC_BTN4,
+    KC_BTN5,
+    KC_BTN6,
+    KC_BTN7,
+    KC_BTN8,
+    KC_WH_U,
+    KC_WH_D,
+    KC_WH_L,
+    KC_WH_R,
+    KC_ACL0,
+    KC_ACL1,
+    KC_ACL2,
+
+    KC_LCTL = 0x00E0,
+    KC_LSFT,
+    KC_LALT,
+    KC_LGUI,
+    KC_RCTL,
+    KC_RSFT,
+    KC_RALT,
+    KC_RGUI,
+
+    // quantum keycodes
+    QK_BOOT  = 0x7C00,
+    QK_RBT   = 0x7C01,
+    DB_TOGG  = 0x7C02,
+    EE_CLR   = 0x7C03,
+    NK_ON    = 0x7013,
+    NK_OFF   = 0x7014,
+    NK_TOGG  = 0x7015,
+    BL_TOGG  = 0x7802,
+    BL_DOWN  = 0x7803,
+    BL_UP    = 0x7804,
+    BL_BRTG  = 0x7806,
+    RGB_TOG  = 0x7820,
+    RGB_MOD  = 0x7821,
+    RGB_RMOD = 0x7822,
+    RGB_HUI  = 0x7823,
+    RGB_HUD  = 0x7824,
+    RGB_SAI  = 0x7825,
+    RGB_SAD  = 0x7826,
+    RGB_VAI  = 0x7827,
+    RGB_VAD  = 0x7828,
+    RGB_SPI  = 0x7829,
+    RGB_SPD  = 0x782A,
+    RGB_M_P  = 0x782B,
+};
+
+#define KC_LEFT_CTRL KC_LCTL
+#define KC_CAPS_LOCK KC_CAPS
+#define KC_MS_BTN1 KC_BTN1
+#define _______ KC_TRNS
+#define XXXXXXX KC_NO
+
+// keycodes.h (ranges)
+#define QK_BASIC 0x0000
+#define QK_BASIC_MAX 0x00FF
+#define QK_MODS 0x0100
+#define QK_MODS_MAX 0x1FFF
+#define QK_MOD_TAP 0x2000
+#define QK_MOD_TAP_MAX 0x3FFF
+#define QK_LAYER_TAP 0x4000
+#define QK_LAYER_TAP_MAX 0x4FFF
+#define QK_LAYER_MOD 0x5000
+#define QK_LAYER_MOD_MAX 0x51FF
+#define QK_TO 0x5200
+#define QK_MOMENTARY 0x5220
+#define QK_MOMENTARY_MAX 0x523F
+#define QK_DEF_LAYER 0x5240
+#define QK_TOGGLE_LAYER 0x5260
+#define QK_TOGGLE_LAYER_MAX 0x527F
+#define QK_ONE_SHOT_LAYER 0x5280
+#define QK_ONE_SHOT_MOD 0x52A0
+#define QK_ONE_SHOT_MOD_MAX 0x52BF
+#define QK_TAP_DANCE 0x5700
+#define QK_TAP_DANCE_MAX 0x57FF
+#define QK_KB 0x7E00
+#define QK_USER 0x7E40
+#define QK_USER_MAX 0x7FFF
+
+#define IS_QK_BASIC(code) ((code) >= QK_BASIC && (code) <= QK_BASIC_MAX)
+#define IS_QK_MODS(code) ((code) >= QK_MODS && (code) <= QK_MODS_MAX)
+#define IS_QK_MOD_TAP(code) ((code) >= QK_MOD_TAP && (code) <= QK_MOD_TAP_MAX)
+#define IS_QK_LAYER_TAP(code) ((code) >= QK_LAYER_TAP && (code) <= QK_LAYER_TAP_MAX)
+#define IS_QK_LAYER_MOD(code) ((code) >= QK_LAYER_MOD && (code) <= QK_LAYER_MOD_MAX)
+#define IS_QK_MOMENTARY(code) ((code) >= QK_MOMENTARY && (code) <= QK_MOMENTARY_MAX)
+#define IS_QK_TOGGLE_LAYER(code) ((code) >= QK_TOGGLE_LAYER && (code) <= QK_TOGGLE_LAYER_MAX)
+#define IS_QK_ONE_SHOT_MOD(code) ((code) >= QK_ONE_SHOT_MOD && (code) <= QK_ONE_SHOT_MOD_MAX)
+#define IS_QK_TAP_DANCE(code) ((code) >= QK_TAP_DANCE && (code) <= QK_TAP_DANCE_MAX)
+
+#define IS_MODIFIER_KEYCODE(code) ((code) >= KC_LCTL && (code) <= KC_RGUI)
+#define IS_MOUSE_KEYCODE(code) ((code) >= KC_MS_U && (code) <= KC_ACL2)
+#define IS_SYSTEM_KEYCODE(code) ((code) >= KC_PWR && (code) <= KC_WAKE)
+#define IS_CONSUMER_KEYCODE(code) ((code) >= KC_MUTE && (code) < KC_MS_U)
+
+// quantum_keycodes.h
+#define MOD_LCTL 0x01
+#define MOD_LSFT 0x02
+#define MOD_LALT 0x04
+#define MOD_LGUI 0x08
+#define MOD_RCTL 0x11
+#define MOD_RSFT 0x12
+#define MOD_RALT 0x14
+#define MOD_RGUI 0x18
+
+#define MOD_BIT(code) (1 << ((code)&0x07))
+#define MOD_MASK_CTRL (MOD_BIT(KC_LCTL) | MOD_BIT(KC_RCTL))
+#define MOD_MASK_SHIFT (MOD_BIT(KC_LSFT) | MOD_BIT(KC_RSFT))
+#define MOD_MASK_ALT (MOD_BIT(KC_LALT) | MOD_BIT(KC_RALT))
+#define MOD_MASK_GUI (MOD_BIT(KC_LGUI) | MOD_BIT(KC_RGUI))
+
+#define QK_LCTL 0x0100
+#define QK_LSFT 0x0200
+#define QK_LALT 0x0400
+#define QK_LGUI 0x0800
+#define QK_RCTL 0x1100
+#define QK_RSFT 0x1200
+#define QK_RALT 0x1400
+#define QK_RGUI 0x1800
+
+#define LCTL(kc) (QK_LCTL | (kc))
+#define LSFT(kc) (QK_LSFT | (kc))
+#define LALT(kc) (QK_LALT | (kc))
+#define LGUI(kc) (QK_LGUI | (kc))
+#define RCTL(kc) (QK_RCTL | (kc))
+#define RSFT(kc) (QK_RSFT | (kc))
+#define RALT(kc) (QK_RALT | (kc))
+#define RGUI(kc) (QK_RGUI | (kc))
+#define C(kc) LCTL(kc)
+#define S(kc) LSFT(kc)
+#define A(kc) LALT(kc)
+#define G(kc) LGUI(kc)
+
+#define LT(layer, kc) (QK_LAYER_TAP | (((layer)&0xF) << 8) | ((kc)&0xFF))
+#define LM(layer, mod) (QK_LAYER_MOD | (((layer)&0xF) << 5) | ((mod)&0x1F))
+#define MO(layer) (QK_MOMENTARY | ((layer)&0x1F))
+#define TG(layer) (QK_TOGGLE_LAYER | ((layer)&0x1F))
+#define OSM(mod) (QK_ONE_SHOT_MOD | ((mod)&0x1F))
+#define TD(index) (QK_TAP_DANCE | ((index)&0xFF))
+
+#define QK_MODS_GET_MODS(kc) (((kc) >> 8) & 0x1F)
+#define QK_MODS_GET_BASIC_KEYCODE(kc) ((kc)&0xFF)
+#define QK_MOD_TAP_GET_TAP_KEYCODE(kc) ((kc)&0xFF)
+#define QK_LAYER_TAP_GET_LAYER(kc) (((kc) >> 8) & 0xF)
+#define QK_LAYER_TAP_GET_TAP_KEYCODE(kc) ((kc)&0xFF)
+#define QK_LAYER_MOD_GET_LAYER(kc) (((kc) >> 5) & 0xF)
+#define QK_LAYER_MOD_GET_MODS(kc) ((kc)&0x1F)
+#define QK_MOMENTARY_GET_LAYER(kc) ((kc)&0x1F)
+#define QK_TOGGLE_LAYER_GET_LAYER(kc) ((kc)&0x1F)
+#define QK_ONE_SHOT_MOD_GET_MODS(kc) ((kc)&0x1F)
+#define QK_TAP_DANCE_GET_INDEX(kc) ((kc)&0xFF)
+
+// The layout of the keyboards which use the 65_ansi_blocker_tsangan_split_bs
+// community layout (the matrix positions are the same as on kprepublic/bm65hsrgb).
+// clang-format off
+#define LAYOUT_65_ansi_blocker_tsangan_split_bs( \
+    k00, k01, k02, k03, k04, k05, k06, k07, k08, k09, k0a, k0b, k0c, k0d, k0e, k0f, \
+    k10, k11, k12, k13, k14, k15, k16, k17, k18, k19, k1a, k1b, k1c, k1d, k1f, \
+    k20, k21, k22, k23, k24, k25, k26, k27, k28, k29, k2a, k2b, k2d, k2f, \
+    k30, k32, k33, k34, k35, k36, k37, k38, k39, k3a, k3b, k3c, k3e, k3f, \
+    k40, k41, k42, k46, k4a, k4d, k4e, k4f \
+) { \
+    { k00, k01,   k02, k03,   k04,   k05,   k06, k07,   k08,   k09,   k0a, k0b,   k0c,   k0d, k0e,   k0f }, \
+    { k10, k11,   k12, k13,   k14,   k15,   k16, k17,   k18,   k19,   k1a, k1b,   k1c,   k1d, KC_NO, k1f }, \
+    { k20, k21,   k22, k23,   k24,   k25,   k26, k27,   k28,   k29,   k2a, k2b,   KC_NO, k2d, KC_NO, k2f }, \
+    { k30, KC_NO, k32, k33,   k34,   k35,   k36, k37,   k38,   k39,   k3a, k3b,   k3c,   KC_NO, k3e, k3f }, \
+    { k40, k41,   k42, KC_NO, KC_NO, KC_NO, k46, KC_NO, KC_NO, KC_NO, k4a, KC_NO, KC_NO, k4d, k4e,   k4f } \
+}
+// clang-format on
+
+// action_util.h, action.h
+uint8_t get_mods(void);
+void    add_mods(uint8_t mods);
+void    del_mods(uint8_t mods);
+void    set_mods(uint8_t mods);
+void    clear_mods(void);
+uint8_t get_weak_mods(void);
+void    add_weak_mods(uint8_t mods);
+void    del_weak_mods(uint8_t mods);
+void    clear_weak_mods(void);
+uint8_t get_oneshot_mods(void);
+void    set_oneshot_mods(uint8_t mods);
+void    clear_oneshot_mods(void);
+uint8_t get_oneshot_locked_mods(void);
+void    add_key(uint8_t key);
+void    del_key(uint8_t key);
+void    send_keyboard_report(void);
+
+void register_code(uint8_t code);
+void unregister_code(uint8_t code);
+void tap_code(uint8_t code);
+void register_code16(uint16_t code);
+void unregister_code16(uint16_t code);
+void tap_code16(uint16_t code);
+
+// action_layer.h
+extern layer_state_t layer_state;
+extern layer_state_t default_layer_state;
+
+void    layer_state_set(layer_state_t state);
+bool    layer_state_is(uint8_t layer);
+bool    layer_state_cmp(layer_state_t state, uint8_t layer);
+void    layer_clear(void);
+void    layer_on(uint8_t layer);
+void    layer_off(uint8_t layer);
+void    layer_invert(uint8_t layer);
+uint8_t get_highest_layer(layer_state_t state);
+uint8_t layer_switch_get_layer(keypos_t key);
+void    update_source_layers_cache(keypos_t key, uint8_t layer);
+
+layer_state_t layer_state_set_user(layer_state_t state);
+layer_state_t default_layer_state_set_user(layer_state_t state);
+
+// backlight.h
+#ifndef BACKLIGHT_LEVELS
+#    define BACKLIGHT_LEVELS 3
+#endif
+
+bool    is_backlight_enabled(void);
+uint8_t get_backlight_level(void);
+void    backlight_set(uint8_t level);
+
+// keymap_common.h, quantum.h (callbacks implemented by the keymap)
+uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key);
+void     keyboard_post_init_user(void);
+void     housekeeping_task_user(void);
+void     suspend_power_down_user(void);
+void     suspend_wakeup_init_user(void);
+bool     pre_process_record_user(uint16_t keycode, keyrecord_t *record);
+bool     process_record_user(uint16_t keycode, keyrecord_t *record);
+uint16_t get_tapping_term(uint16_t keycode, keyrecord_t *record);
+bool     get_hold_on_other_key_press(uint16_t keycode, keyrecord_t *record);
+
+// process_tap_dance.h
+typedef struct {
+    uint16_t interrupting_keycode;
+    uint8_t  count;
+    uint8_t  weak_mods;
+    uint8_t  oneshot_mods;
+    bool     pressed : 1;
+    bool     finished : 1;
+    bool     interrupted : 1;
+} tap_dance_state_t;
+
+typedef void (*tap_dance_user_fn_t)(tap_dance_state_t *state, void *user_data);
+
+typedef struct {
+    tap_dance_state_t state;
+    struct {
+        tap_dance_user_fn_t on_each_tap;
+        tap_dance_user_fn_t on_dance_finished;
+        tap_dance_user_fn_t on_reset;
+        tap_dance_user_fn_t on_each_release;
+    } fn;
+    void *user_data;
+} tap_dance_action_t;
+
+#define ACTION_TAP_DANCE_FN_ADVANCED(user_fn_on_each_tap, user_fn_on_dance_finished, user_fn_on_dance_reset) \
+    { .fn = {user_fn_on_each_tap, user_fn_on_dance_finished, user_fn_on_dance_reset, NULL}, .user_data = NULL, }
+
+// keymap_introspection.h (implemented by keymap_test.h, which includes the
+// keymap)
+uint16_t            tap_dance_count(void);
+tap_dance_action_t *tap_dance_get(uint16_t tap_dance_idx);
+
+// process_combo.h
+typedef struct {
+    const uint16_t *keys;
+    uint16_t        keycode;
+    bool            disabled;
+    bool            active;
+    uint16_t        state;
+} combo_t;
+
+#define COMBO(ck, ca) \
+    { .keys = &(ck)[0], .keycode = (ca) }
+#define COMBO_END 0
+
+uint16_t combo_count(void);
+combo_t *combo_get(uint16_t combo_idx);
+uint16_t get_combo_term(uint16_t index, combo_t *combo);
+bool     get_combo_must_hold(uint16_t index, combo_t *combo);
+bool     get_combo_must_press_in_order(uint16_t index, combo_t *combo);
+
+// report.h, host.h, host_driver.h
+#define KEYBOARD_REPORT_KEYS 6
+#define NKRO_REPORT_BITS 30
+
+typedef struct {
+    uint8_t mods;
+    uint8_t reserved;
+    uint8_t keys[KEYBOARD_REPORT_KEYS];
+} report_keyboard_t;
+
+typedef struct {
+    uint8_t report_id;
+    uint8_t mods;
+    uint8_t bits[NKRO_REPORT_BITS];
+} report_nkro_t;
+
+typedef struct {
+    uint8_t report_id;
+    uint8_t buttons;
+    int8_t  x;
+    int8_t  y;
+    int8_t  v;
+    int8_t  h;
+} report_mouse_t;
+
+typedef struct {
+    uint8_t  report_id;
+    uint16_t usage;
+} report_extra_t;
+
+typedef struct {
+    uint8_t (*keyboard_leds)(void);
+    void (*send_keyboard)(report_keyboard_t *);
+    void (*send_nkro)(report_nkro_t *);
+    void (*send_mouse)(report_mouse_t *);
+    void (*send_extra)(report_extra_t *);
+} host_driver_t;
+
+host_driver_t *host_get_driver(void);
+void           host_set_driver(host_driver_t *driver);
+
+// eeconfig.h, eeprom.h
+#define EECONFIG_BASE_SIZE 37
+#ifndef EECONFIG_USER_DATA_SIZE
+#    define EECONFIG_USER_DATA_SIZE 0
+#endif
+#define EECONFIG_SIZE (EECONFIG_BASE_SIZE + EECONFIG_USER_DATA_SIZE)
+#ifndef TOTAL_EEPROM_BYTE_COUNT
+#    define TOTAL_EEPROM_BYTE_COUNT 2048
+#endif
+
+uint32_t eeconfig_read_user(void);
+void     eeconfig_update_user(uint32_t val);
+bool     eeconfig_is_user_datablock_valid(void);
+uint32_t eeconfig_read_user_datablock(void *data, uint32_t offset, uint32_t length);
+uint32_t eeconfig_update_user_datablock(const void *data, uint32_t offset, uint32_t length);
+void     eeconfig_init_user_datablock(void);
+
+// print.h, send_string.h, raw_hid.h
+#define RAW_EPSIZE 32
+
+void uprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define dprintf(...) ((void)0)
+void send_string(const char *string);
+void raw_hid_send(uint8_t *data, uint8_t length);
+void raw_hid_receive(uint8_t *data, uint8_t length);
+
+// debounce.h
+void debounce_init(uint8_t num_rows);
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], uint8_t num_rows, bool changed);
+void debounce_free(void);
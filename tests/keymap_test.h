@@ -0,0 +1,73 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Test access to the keymap: keymap.c is included into every test program, so
+// that the tests can use its keycodes, layer names and layout positions.  This
+// header must be included by exactly one file of a test program.
+
+#pragma once
+
+#include <stdlib.h>
+#include "test.h"
+#include "keymap.c"
+
+// Keymap introspection (generated from the keymap by the QMK build).
+#ifdef TAP_DANCE_ENABLE
+uint16_t tap_dance_count(void) {
+    return ARRAY_SIZE(tap_dance_actions);
+}
+
+tap_dance_action_t *tap_dance_get(uint16_t tap_dance_idx) {
+    return &tap_dance_actions[tap_dance_idx];
+}
+#endif
+
+#ifdef COMBO_ENABLE
+uint16_t combo_count(void) {
+    return ARRAY_SIZE(key_combos);
+}
+
+combo_t *combo_get(uint16_t combo_idx) {
+    return &key_combos[combo_idx];
+}
+#endif
+
+// Matrix position of the key at the layout position.
+static inline keypos_t key_at(uint8_t position) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            keypos_t key = {.row = row, .col = col};
+            if (get_layout_position(key) == position) {
+                return key;
+            }
+        }
+    }
+    fprintf(stderr, "no key at layout position %u\n", position);
+    abort();
+}
+
+static inline void press(uint8_t position) {
+    sim_key(key_at(position), true);
+}
+
+static inline void release(uint8_t position) {
+    sim_key(key_at(position), false);
+}
+
+// Press and release the key, holding it for `hold` ms; then wait for `gap` ms.
+static inline void tap_hold(uint8_t position, uint32_t hold, uint32_t gap) {
+    press(position);
+    sim_advance(hold);
+    release(position);
+    sim_advance(gap);
+}
+
+static inline void tap(uint8_t position) {
+    tap_hold(position, 20, 20);
+}
+
+// Wait until all pending key processing is finished (the tap dances and the
+// combos are resolved, deferred EEPROM writes are not included).
+static inline void settle(void) {
+    sim_advance(TAPPING_TERM * 2 + 1000);
+}
@@ -0,0 +1,323 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Replay of recorded or synthetic key event traces through the keymap with
+// latency measurements:
+// - CPU time of every main loop iteration with a key event (the event and the
+//   tasks, measured on the host, therefore only useful for comparisons);
+// - emission delay of every key press: the time from the key event to the
+//   first report which is sent after it (the delay added by combos, tap-hold
+//   keys and report batching).  Presses of keys which are resolved on release
+//   or after the tapping term (layer tap keys, tap dances, custom keycodes)
+//   are not counted.
+//
+// Usage:
+//     replay [--budgets <file>] <trace>...
+//     replay --bench <iterations>
+//
+// Trace format: one event per line, `<time ms> <layout position> <d|u>`, where
+// the layout position is the name from `enum layout_positions` without the
+// `LP_` prefix; `#` starts a comment.  The budget file has lines in the format
+// `<trace name pattern> <delay p99 ms> <CPU p99 us>`; the first line which
+// matches the trace file name (without the directory) is used.
+//
+// The --bench mode measures the keycode lookup (`keymap_key_to_keycode()` for
+// all keys on all active layers, as done by layer_switch_get_layer()) with a
+// layer change between the lookup rounds.
+
+#include "sim.h"
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "keymap.c"
+
+// Keymap introspection (generated from the keymap by the QMK build).
+#ifdef TAP_DANCE_ENABLE
+uint16_t tap_dance_count(void) {
+    return ARRAY_SIZE(tap_dance_actions);
+}
+
+tap_dance_action_t *tap_dance_get(uint16_t tap_dance_idx) {
+    return &tap_dance_actions[tap_dance_idx];
+}
+#endif
+
+#ifdef COMBO_ENABLE
+uint16_t combo_count(void) {
+    return ARRAY_SIZE(key_combos);
+}
+
+combo_t *combo_get(uint16_t combo_idx) {
+    return &key_combos[combo_idx];
+}
+#endif
+
+#define MAX_EVENTS 100000
+
+// clang-format off
+#define POSITION(name) {#name, LP_##name}
+static const struct {
+    const char *name;
+    uint8_t     position;
+} position_names[] = {
+    POSITION(GRV), POSITION(1), POSITION(2), POSITION(3), POSITION(4), POSITION(5), POSITION(6), POSITION(7), POSITION(8),
+    POSITION(9), POSITION(0), POSITION(MINS), POSITION(EQL), POSITION(BSLS), POSITION(INS), POSITION(DEL),
+    POSITION(TAB), POSITION(Q), POSITION(W), POSITION(E), POSITION(R), POSITION(T), POSITION(Y), POSITION(U), POSITION(I),
+    POSITION(O), POSITION(P), POSITION(LBRC), POSITION(RBRC), POSITION(BSPC), POSITION(PGUP),
+    POSITION(ESC), POSITION(A), POSITION(S), POSITION(D), POSITION(F), POSITION(G), POSITION(H), POSITION(J), POSITION(K),
+    POSITION(L), POSITION(SCLN), POSITION(QUOT), POSITION(ENT), POSITION(PGDN),
+    POSITION(LSFT), POSITION(Z), POSITION(X), POSITION(C), POSITION(V), POSITION(B), POSITION(N), POSITION(M),
+    POSITION(COMM), POSITION(DOT), POSITION(SLSH), POSITION(RSFT), POSITION(UP), POSITION(RCTL),
+    POSITION(LCTL), POSITION(LGUI), POSITION(LALT), POSITION(SPC), POSITION(RALT), POSITION(LEFT), POSITION(DOWN), POSITION(RGHT),
+};
+// clang-format on
+
+typedef struct {
+    uint32_t time;
+    uint8_t  position;
+    bool     pressed;
+} trace_event_t;
+
+static trace_event_t events[MAX_EVENTS];
+static uint32_t      event_count;
+static uint64_t      cpu_ns[MAX_EVENTS];
+static uint32_t      delays[MAX_EVENTS];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static keypos_t position_key(uint8_t position) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            keypos_t key = {.row = row, .col = col};
+            if (get_layout_position(key) == position) {
+                return key;
+            }
+        }
+    }
+    abort();
+}
+
+static bool read_trace(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    char     line[256];
+    unsigned line_number = 0;
+    event_count          = 0;
+    while (fgets(line, sizeof(line), file)) {
+        ++line_number;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        unsigned long time;
+        char          name[16], action[2];
+        int           fields = sscanf(line, "%lu %15s %1s", &time, name, action);
+        if (fields <= 0) {
+            continue;
+        }
+
+        uint8_t position = LP_NONE;
+        for (uint8_t i = 0; i < ARRAY_SIZE(position_names); ++i) {
+            if (strcmp(position_names[i].name, name) == 0) {
+                position = position_names[i].position;
+            }
+        }
+        if (fields != 3 || position == LP_NONE || (action[0] != 'd' && action[0] != 'u') || event_count >= MAX_EVENTS || (event_count > 0 && time < events[event_count - 1].time)) {
+            fprintf(stderr, "%s:%u: invalid event\n", path, line_number);
+            fclose(file);
+            return false;
+        }
+        events[event_count++] = (trace_event_t){.time = time, .position = position, .pressed = action[0] == 'd'};
+    }
+    fclose(file);
+    return true;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Keys whose presses are expected to produce a report without waiting for the
+// release (combo keys are included, because the combo term delay is a part of
+// the latency).
+static bool is_immediate_key(keypos_t key) {
+    uint16_t keycode = keymap_key_to_keycode(layer_switch_get_layer(key), key);
+    return IS_QK_BASIC(keycode) || IS_QK_MODS(keycode);
+}
+
+typedef struct {
+    uint32_t delay_p99; // ms
+    uint32_t cpu_p99;   // us
+} budget_t;
+
+static bool find_budget(const char *budgets_path, const char *trace_path, budget_t *budget) {
+    FILE *file = fopen(budgets_path, "r");
+    if (!file) {
+        perror(budgets_path);
+        exit(2);
+    }
+
+    const char *trace_name = strrchr(trace_path, '/') ? strrchr(trace_path, '/') + 1 : trace_path;
+    char        line[256];
+    bool        found = false;
+    while (!found && fgets(line, sizeof(line), file)) {
+        char     pattern[128];
+        unsigned delay, cpu;
+        if (line[0] == '#' || sscanf(line, "%127s %u %u", pattern, &delay, &cpu) != 3) {
+            continue;
+        }
+        if (fnmatch(pattern, trace_name, 0) == 0) {
+            budget->delay_p99 = delay;
+            budget->cpu_p99   = cpu;
+            found             = true;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+// Replay the trace; returns false if a budget was exceeded.
+static bool replay(const char *path, const char *budgets_path) {
+    if (!read_trace(path)) {
+        return false;
+    }
+
+    sim_eeprom_clear();
+    sim_init();
+
+    uint32_t base        = sim_now();
+    uint32_t delay_count = 0;
+    uint32_t pending     = 0; // index of the first report after the measured press
+    bool     measuring   = false;
+    for (uint32_t i = 0; i < event_count; ++i) {
+        sim_advance_to(base + events[i].time);
+        if (measuring && sim_report_count > pending) {
+            delays[delay_count++] = sim_reports[pending].time - (base + events[i - 1].time);
+            measuring             = false;
+        }
+
+        keypos_t key       = position_key(events[i].position);
+        bool     immediate = events[i].pressed && is_immediate_key(key);
+        uint32_t reports   = sim_report_count;
+        uint64_t start     = now_ns();
+        sim_key(key, events[i].pressed);
+        cpu_ns[i] = now_ns() - start;
+
+        if (measuring) {
+            // No report before the next event: the delay is the time until that
+            // event (or until the report sent during it).
+            delays[delay_count++] = sim_now() - (base + events[i - 1].time);
+            measuring             = false;
+        }
+        if (immediate) {
+            if (sim_report_count > reports) {
+                delays[delay_count++] = sim_reports[reports].time - (base + events[i].time);
+            } else {
+                pending   = reports;
+                measuring = true;
+            }
+        }
+    }
+    sim_advance(TAPPING_TERM * 2 + 1000);
+    if (measuring) {
+        delays[delay_count++] = (sim_report_count > pending ? sim_reports[pending].time : sim_now()) - (base + events[event_count - 1].time);
+    }
+
+    bool stuck = !sim_host_idle() || sim_real_mods() || sim_weak_mods() || layer_state;
+
+    qsort(cpu_ns, event_count, sizeof(cpu_ns[0]), compare_u64);
+    qsort(delays, delay_count, sizeof(delays[0]), compare_u32);
+
+    uint64_t cpu_p50   = event_count ? cpu_ns[event_count / 2] : 0;
+    uint64_t cpu_p99   = event_count ? cpu_ns[event_count * 99 / 100] : 0;
+    uint64_t cpu_max   = event_count ? cpu_ns[event_count - 1] : 0;
+    uint32_t delay_p50 = delay_count ? delays[delay_count / 2] : 0;
+    uint32_t delay_p99 = delay_count ? delays[delay_count * 99 / 100] : 0;
+    uint32_t delay_max = delay_count ? delays[delay_count - 1] : 0;
+
+    printf("%s: %u events, CPU us p50/p99/max %.1f/%.1f/%.1f, %u presses, delay ms p50/p99/max %u/%u/%u\n", path, (unsigned)event_count, cpu_p50 / 1000.0, cpu_p99 / 1000.0, cpu_max / 1000.0, (unsigned)delay_count, (unsigned)delay_p50, (unsigned)delay_p99, (unsigned)delay_max);
+
+    bool     ok = true;
+    budget_t budget;
+    if (stuck) {
+        printf("%s: FAIL: keys, modifiers or layers are left active\n", path);
+        ok = false;
+    }
+    if (budgets_path) {
+        if (!find_budget(budgets_path, path, &budget)) {
+            printf("%s: FAIL: no latency budget\n", path);
+            ok = false;
+        } else {
+            if (delay_p99 > budget.delay_p99) {
+                printf("%s: FAIL: delay p99 %u ms > %u ms\n", path, (unsigned)delay_p99, (unsigned)budget.delay_p99);
+                ok = false;
+            }
+            if (cpu_p99 > budget.cpu_p99 * 1000u) {
+                printf("%s: FAIL: CPU p99 %.1f us > %u us\n", path, cpu_p99 / 1000.0, (unsigned)budget.cpu_p99);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static void bench(unsigned long iterations) {
+    static const layer_state_t states[] = {0, 1 << _FN, 1 << _NUMPAD, (1 << _FN) | (1 << _ADJUST), (1 << _FN) | (1 << _FN_CTL)};
+    volatile uint16_t          sink     = 0;
+
+    sim_eeprom_clear();
+    sim_init();
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < iterations; ++i) {
+        layer_state_set(states[i % ARRAY_SIZE(states)]);
+        for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+            for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+                sink = keymap_key_to_keycode(layer_switch_get_layer((keypos_t){.row = row, .col = col}), (keypos_t){.row = row, .col = col});
+            }
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    (void)sink;
+    printf("keycode lookup: %.1f ns per key (%lu rounds of %u keys)\n", (double)elapsed / iterations / (MATRIX_ROWS * MATRIX_COLS), iterations, MATRIX_ROWS * MATRIX_COLS);
+}
+
+int main(int argc, char **argv) {
+    const char *budgets_path = NULL;
+    int         arg          = 1;
+
+    if (argc == 3 && strcmp(argv[1], "--bench") == 0) {
+        bench(strtoul(argv[2], NULL, 0));
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--budgets") == 0) {
+        budgets_path = argv[2];
+        arg          = 3;
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "Usage: %s [--budgets <file>] <trace>...\n       %s --bench <iterations>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    for (; arg < argc; ++arg) {
+        ok &= replay(argv[arg], budgets_path);
+    }
+    return ok ? 0 : 1;
+}
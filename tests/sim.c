@@ -0,0 +1,1293 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Model of the QMK core (version 0.22) for running the keymap natively.  The
+// key processing follows the QMK code paths which the keymap depends on:
+//
+//     action_exec()
+//       pre_process_record_user(), then the combo engine
+//       action_tapping_process() (layer tap keys)
+//         process_record()
+//           preprocess_tap_dance(), process_record_user(),
+//           process_tap_dance(), then the action for the keycode
+//
+// with the source layer cache, the weak and one shot modifiers, the report
+// deduplication and the tap dance state machine reimplemented after the QMK
+// code.  Simplifications:
+// - debounce is not modeled (events are debounced key changes);
+// - layer tap keys support the tapping term, HOLD_ON_OTHER_KEY_PRESS and
+//   quick taps, but not PERMISSIVE_HOLD or retro tapping, and mod tap keys are
+//   not supported at all;
+// - one shot modifiers are registered while held and become one shot on a
+//   release without any other key press (no tap toggle, no timeout);
+// - mouse reports contain only the buttons, and the extra report usage is
+//   the keycode;
+// - the main loop runs once per ms (wait_ms() advances the time without
+//   running the loop).
+
+#include "sim.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifndef COMBO_TERM
+#    define COMBO_TERM 50
+#endif
+#ifndef COMBO_HOLD_TERM
+#    define COMBO_HOLD_TERM TAPPING_TERM
+#endif
+#ifndef COMBO_ONLY_FROM_LAYER
+#    define COMBO_ONLY_FROM_LAYER 0
+#endif
+
+#define SIM_MAX_LAYERS 32
+#define SIM_MAX_BUFFERED 32
+#define SIM_MAX_COMBOS 32
+#define COMBO_KEY_ROW 254
+
+// Time, matrix and activity
+// =========================
+
+static uint32_t     now;
+static uint32_t     last_input_activity;
+static matrix_row_t matrix[MATRIX_ROWS];
+
+uint32_t sim_now(void) {
+    return now;
+}
+
+uint16_t timer_read(void) {
+    return (uint16_t)now;
+}
+
+uint32_t timer_read32(void) {
+    return now;
+}
+
+uint16_t timer_elapsed(uint16_t last) {
+    return TIMER_DIFF_16(timer_read(), last);
+}
+
+uint32_t timer_elapsed32(uint32_t last) {
+    return TIMER_DIFF_32(timer_read32(), last);
+}
+
+fast_timer_t timer_read_fast(void) {
+    return now;
+}
+
+void wait_ms(uint32_t ms) {
+    now += ms;
+}
+
+uint32_t last_input_activity_elapsed(void) {
+    return now - last_input_activity;
+}
+
+uint32_t last_matrix_activity_elapsed(void) {
+    return now - last_input_activity;
+}
+
+matrix_row_t matrix_get_row(uint8_t row) {
+    return matrix[row];
+}
+
+bool sim_keys_pressed(void) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        if (matrix[row]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Host
+// ====
+
+sim_report_t sim_reports[SIM_MAX_REPORTS];
+uint32_t     sim_report_count;
+
+static report_keyboard_t host_keyboard;
+static uint8_t           host_buttons;
+
+static sim_report_t *add_report(sim_report_type_t type) {
+    if (sim_report_count >= SIM_MAX_REPORTS) {
+        fprintf(stderr, "sim: too many host reports\n");
+        abort();
+    }
+    sim_report_t *report = &sim_reports[sim_report_count++];
+    memset(report, 0, sizeof(*report));
+    report->time = now;
+    report->type = type;
+    return report;
+}
+
+static uint8_t host_keyboard_leds(void) {
+    return 0;
+}
+
+static void host_send_keyboard(report_keyboard_t *report) {
+    sim_report_t *entry = add_report(SIM_REPORT_KEYBOARD);
+    entry->mods         = report->mods;
+    memcpy(entry->keys, report->keys, sizeof(entry->keys));
+    host_keyboard = *report;
+}
+
+static void host_send_nkro(report_nkro_t *report) {
+    add_report(SIM_REPORT_NKRO)->mods = report->mods;
+}
+
+static void host_send_mouse(report_mouse_t *report) {
+    add_report(SIM_REPORT_MOUSE)->buttons = report->buttons;
+    host_buttons                          = report->buttons;
+}
+
+static void host_send_extra(report_extra_t *report) {
+    add_report(SIM_REPORT_EXTRA)->usage = report->usage;
+}
+
+static host_driver_t  sim_host_driver = {host_keyboard_leds, host_send_keyboard, host_send_nkro, host_send_mouse, host_send_extra};
+static host_driver_t *host_driver;
+
+host_driver_t *host_get_driver(void) {
+    return host_driver;
+}
+
+void host_set_driver(host_driver_t *driver) {
+    host_driver = driver;
+}
+
+uint8_t sim_host_mods(void) {
+    return host_keyboard.mods;
+}
+
+static bool report_has_key(const uint8_t *keys, uint8_t keycode) {
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        if (keys[i] == keycode) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sim_host_key(uint8_t keycode) {
+    if (IS_MODIFIER_KEYCODE(keycode)) {
+        return host_keyboard.mods & MOD_BIT(keycode);
+    }
+    return report_has_key(host_keyboard.keys, keycode);
+}
+
+uint8_t sim_host_buttons(void) {
+    return host_buttons;
+}
+
+bool sim_host_idle(void) {
+    static const uint8_t no_keys[KEYBOARD_REPORT_KEYS];
+    return host_keyboard.mods == 0 && memcmp(host_keyboard.keys, no_keys, sizeof(no_keys)) == 0 && host_buttons == 0;
+}
+
+static uint32_t count_presses(uint32_t start, uint8_t keycode, bool check_mods, uint8_t mods) {
+    uint32_t presses = 0;
+    bool     down    = false;
+    for (uint32_t i = 0; i < sim_report_count; ++i) {
+        const sim_report_t *report = &sim_reports[i];
+        if (report->type != SIM_REPORT_KEYBOARD) {
+            continue;
+        }
+        bool next = IS_MODIFIER_KEYCODE(keycode) ? (report->mods & MOD_BIT(keycode)) != 0 : report_has_key(report->keys, keycode);
+        if (next && !down && i >= start && (!check_mods || report->mods == mods)) {
+            ++presses;
+        }
+        down = next;
+    }
+    return presses;
+}
+
+uint32_t sim_host_presses(uint32_t start, uint8_t keycode) {
+    return count_presses(start, keycode, false, 0);
+}
+
+uint32_t sim_host_chords(uint32_t start, uint8_t keycode, uint8_t mods) {
+    return count_presses(start, keycode, true, mods);
+}
+
+void sim_reports_clear(void) {
+    sim_report_count = 0;
+}
+
+// Keyboard report (action_util.c)
+// ===============================
+
+static uint8_t           real_mods;
+static uint8_t           weak_mods;
+static uint8_t           oneshot_mods;
+static report_keyboard_t keyboard_report;
+static report_keyboard_t last_report;
+
+uint8_t get_mods(void) {
+    return real_mods;
+}
+
+void add_mods(uint8_t mods) {
+    real_mods |= mods;
+}
+
+void del_mods(uint8_t mods) {
+    real_mods &= ~mods;
+}
+
+void set_mods(uint8_t mods) {
+    real_mods = mods;
+}
+
+void clear_mods(void) {
+    real_mods = 0;
+}
+
+uint8_t get_weak_mods(void) {
+    return weak_mods;
+}
+
+void add_weak_mods(uint8_t mods) {
+    weak_mods |= mods;
+}
+
+void del_weak_mods(uint8_t mods) {
+    weak_mods &= ~mods;
+}
+
+void clear_weak_mods(void) {
+    weak_mods = 0;
+}
+
+uint8_t get_oneshot_mods(void) {
+    return oneshot_mods;
+}
+
+void set_oneshot_mods(uint8_t mods) {
+    oneshot_mods = mods;
+}
+
+void clear_oneshot_mods(void) {
+    oneshot_mods = 0;
+}
+
+uint8_t get_oneshot_locked_mods(void) {
+    return 0;
+}
+
+uint8_t sim_real_mods(void) {
+    return real_mods;
+}
+
+uint8_t sim_weak_mods(void) {
+    return weak_mods;
+}
+
+void add_key(uint8_t key) {
+    if (report_has_key(keyboard_report.keys, key)) {
+        return;
+    }
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        if (keyboard_report.keys[i] == KC_NO) {
+            keyboard_report.keys[i] = key;
+            return;
+        }
+    }
+}
+
+void del_key(uint8_t key) {
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        if (keyboard_report.keys[i] == key) {
+            keyboard_report.keys[i] = KC_NO;
+        }
+    }
+}
+
+static bool has_anykey(void) {
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; ++i) {
+        if (keyboard_report.keys[i] != KC_NO) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void send_keyboard_report(void) {
+    keyboard_report.mods = real_mods | weak_mods;
+    if (oneshot_mods) {
+        keyboard_report.mods |= oneshot_mods;
+        if (has_anykey()) {
+            clear_oneshot_mods();
+        }
+    }
+    // Only changed reports are sent (as in send_6kro_report()).
+    if (memcmp(&keyboard_report, &last_report, sizeof(keyboard_report)) != 0) {
+        last_report = keyboard_report;
+        if (host_driver) {
+            host_driver->send_keyboard(&keyboard_report);
+        }
+    }
+}
+
+// Keycodes (action.c)
+// ===================
+
+static report_mouse_t mouse_report;
+
+static void send_mouse_report(void) {
+    if (host_driver) {
+        host_driver->send_mouse(&mouse_report);
+    }
+}
+
+static void send_extra_report(uint16_t usage) {
+    report_extra_t report = {.usage = usage};
+    if (host_driver) {
+        host_driver->send_extra(&report);
+    }
+}
+
+static uint8_t mods_5_to_8(uint8_t mods) {
+    return (mods & 0x10) ? (mods & 0x0F) << 4 : mods & 0x0F;
+}
+
+void register_code(uint8_t code) {
+    if (code == KC_NO || code == KC_TRNS) {
+        return;
+    }
+    if (IS_MODIFIER_KEYCODE(code)) {
+        add_mods(MOD_BIT(code));
+        send_keyboard_report();
+    } else if (IS_MOUSE_KEYCODE(code)) {
+        if (code >= KC_BTN1 && code <= KC_BTN8) {
+            mouse_report.buttons |= 1 << (code - KC_BTN1);
+        }
+        send_mouse_report();
+    } else if (IS_SYSTEM_KEYCODE(code) || IS_CONSUMER_KEYCODE(code)) {
+        send_extra_report(code);
+    } else if (code < KC_PWR) {
+        add_key(code);
+        send_keyboard_report();
+    }
+}
+
+void unregister_code(uint8_t code) {
+    if (code == KC_NO || code == KC_TRNS) {
+        return;
+    }
+    if (IS_MODIFIER_KEYCODE(code)) {
+        del_mods(MOD_BIT(code));
+        send_keyboard_report();
+    } else if (IS_MOUSE_KEYCODE(code)) {
+        if (code >= KC_BTN1 && code <= KC_BTN8) {
+            mouse_report.buttons &= ~(1 << (code - KC_BTN1));
+        }
+        send_mouse_report();
+    } else if (IS_SYSTEM_KEYCODE(code) || IS_CONSUMER_KEYCODE(code)) {
+        send_extra_report(0);
+    } else if (code < KC_PWR) {
+        del_key(code);
+        send_keyboard_report();
+    }
+}
+
+void tap_code(uint8_t code) {
+    tap_code16(code);
+}
+
+static void register_mods(uint8_t mods) {
+    if (mods) {
+        add_mods(mods);
+        send_keyboard_report();
+    }
+}
+
+static void unregister_mods(uint8_t mods) {
+    if (mods) {
+        del_mods(mods);
+        send_keyboard_report();
+    }
+}
+
+void register_code16(uint16_t code) {
+    uint8_t mods = IS_QK_MODS(code) ? mods_5_to_8(QK_MODS_GET_MODS(code)) : 0;
+    if (IS_MODIFIER_KEYCODE(code & 0xFF) || (code & 0xFF) == KC_NO) {
+        register_mods(mods);
+    } else if (mods) {
+        add_weak_mods(mods);
+        send_keyboard_report();
+    }
+    register_code(code & 0xFF);
+}
+
+void unregister_code16(uint16_t code) {
+    uint8_t mods = IS_QK_MODS(code) ? mods_5_to_8(QK_MODS_GET_MODS(code)) : 0;
+    unregister_code(code & 0xFF);
+    if (IS_MODIFIER_KEYCODE(code & 0xFF) || (code & 0xFF) == KC_NO) {
+        unregister_mods(mods);
+    } else if (mods) {
+        del_weak_mods(mods);
+        send_keyboard_report();
+    }
+}
+
+void tap_code16(uint16_t code) {
+    register_code16(code);
+    wait_ms(code == KC_CAPS ? TAP_HOLD_CAPS_DELAY : TAP_CODE_DELAY);
+    unregister_code16(code);
+}
+
+// Layers (action_layer.c)
+// =======================
+
+layer_state_t layer_state;
+layer_state_t default_layer_state;
+
+static uint8_t source_layers[MATRIX_ROWS][MATRIX_COLS];
+
+void layer_state_set(layer_state_t state) {
+    layer_state = layer_state_set_user(state);
+}
+
+bool layer_state_cmp(layer_state_t state, uint8_t layer) {
+    if (!state) {
+        return layer == 0;
+    }
+    return (state & ((layer_state_t)1 << layer)) != 0;
+}
+
+bool layer_state_is(uint8_t layer) {
+    return layer_state_cmp(layer_state, layer);
+}
+
+void layer_clear(void) {
+    layer_state_set(0);
+}
+
+void layer_on(uint8_t layer) {
+    layer_state_set(layer_state | ((layer_state_t)1 << layer));
+}
+
+void layer_off(uint8_t layer) {
+    layer_state_set(layer_state & ~((layer_state_t)1 << layer));
+}
+
+void layer_invert(uint8_t layer) {
+    layer_state_set(layer_state ^ ((layer_state_t)1 << layer));
+}
+
+uint8_t get_highest_layer(layer_state_t state) {
+    uint8_t layer = 0;
+    for (uint8_t i = 0; i < SIM_MAX_LAYERS; ++i) {
+        if (state & ((layer_state_t)1 << i)) {
+            layer = i;
+        }
+    }
+    return layer;
+}
+
+uint8_t layer_switch_get_layer(keypos_t key) {
+    layer_state_t layers = layer_state | default_layer_state;
+    for (int8_t i = SIM_MAX_LAYERS - 1; i >= 0; i--) {
+        if ((layers & ((layer_state_t)1 << i)) && keymap_key_to_keycode(i, key) != KC_TRNS) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void update_source_layers_cache(keypos_t key, uint8_t layer) {
+    if (key.row < MATRIX_ROWS && key.col < MATRIX_COLS) {
+        source_layers[key.row][key.col] = layer;
+    }
+}
+
+static uint16_t get_record_keycode(keyrecord_t *record, bool update_layer_cache) {
+    keyevent_t event = record->event;
+    if (record->keycode) {
+        return record->keycode;
+    }
+    if (event.key.row >= MATRIX_ROWS || event.key.col >= MATRIX_COLS) {
+        return KC_NO;
+    }
+    uint8_t layer;
+    if (event.pressed && update_layer_cache) {
+        layer = layer_switch_get_layer(event.key);
+        update_source_layers_cache(event.key, layer);
+    } else {
+        layer = source_layers[event.key.row][event.key.col];
+    }
+    return keymap_key_to_keycode(layer, event.key);
+}
+
+static bool same_key(keypos_t a, keypos_t b) {
+    return a.row == b.row && a.col == b.col;
+}
+
+// Tap dance (process_tap_dance.c)
+// ===============================
+
+static uint16_t active_td;
+static uint16_t last_tap_time;
+
+static void td_call(tap_dance_action_t *action, tap_dance_user_fn_t fn) {
+    if (fn) {
+        fn(&action->state, action->user_data);
+    }
+}
+
+static void td_on_reset(tap_dance_action_t *action) {
+    td_call(action, action->fn.on_reset);
+    del_weak_mods(action->state.weak_mods);
+    del_mods(action->state.oneshot_mods);
+    send_keyboard_report();
+    memset(&action->state, 0, sizeof(action->state));
+}
+
+static void td_on_dance_finished(tap_dance_action_t *action) {
+    if (!action->state.finished) {
+        action->state.finished = true;
+        add_weak_mods(action->state.weak_mods);
+        add_mods(action->state.oneshot_mods);
+        send_keyboard_report();
+        td_call(action, action->fn.on_dance_finished);
+    }
+    active_td = 0;
+    if (!action->state.pressed) {
+        // There will not be a key release event, so reset now.
+        td_on_reset(action);
+    }
+}
+
+static bool preprocess_tap_dance(uint16_t keycode, keyrecord_t *record) {
+    if (!record->event.pressed || !active_td || keycode == active_td) {
+        return false;
+    }
+    tap_dance_action_t *action          = tap_dance_get(QK_TAP_DANCE_GET_INDEX(active_td));
+    action->state.interrupted           = true;
+    action->state.interrupting_keycode  = keycode;
+    td_on_dance_finished(action);
+    // The weak modifiers left by the tap dance must not affect the key which
+    // interrupted it.
+    clear_weak_mods();
+    return true;
+}
+
+static void process_tap_dance(uint16_t keycode, keyrecord_t *record) {
+    if (!IS_QK_TAP_DANCE(keycode) || QK_TAP_DANCE_GET_INDEX(keycode) >= tap_dance_count()) {
+        return;
+    }
+    tap_dance_action_t *action = tap_dance_get(QK_TAP_DANCE_GET_INDEX(keycode));
+
+    action->state.pressed = record->event.pressed;
+    if (record->event.pressed) {
+        last_tap_time = timer_read();
+        action->state.count++;
+        action->state.weak_mods    = get_mods() | get_weak_mods();
+        action->state.oneshot_mods = get_oneshot_mods();
+        td_call(action, action->fn.on_each_tap);
+        active_td = action->state.finished ? 0 : keycode;
+    } else {
+        td_call(action, action->fn.on_each_release);
+        if (action->state.finished) {
+            td_on_reset(action);
+            if (active_td == keycode) {
+                active_td = 0;
+            }
+        }
+    }
+}
+
+static void tap_dance_task(void) {
+    if (!active_td || timer_elapsed(last_tap_time) <= get_tapping_term(active_td, &(keyrecord_t){})) {
+        return;
+    }
+    tap_dance_action_t *action = tap_dance_get(QK_TAP_DANCE_GET_INDEX(active_td));
+    if (!action->state.interrupted) {
+        td_on_dance_finished(action);
+    }
+}
+
+// Actions (action.c, quantum.c)
+// =============================
+
+static uint32_t bootloader_jumps;
+static uint8_t  oneshot_held_mods;
+static bool     oneshot_interrupted;
+
+uint32_t sim_bootloader_jumps(void) {
+    return bootloader_jumps;
+}
+
+static void process_action(uint16_t keycode, keyrecord_t *record) {
+    bool pressed = record->event.pressed;
+
+    if (pressed) {
+        // Clear the weak modifiers left by previously pressed keys.
+        clear_weak_mods();
+        if (!IS_QK_ONE_SHOT_MOD(keycode)) {
+            oneshot_interrupted = true;
+        }
+    }
+
+    if (IS_QK_BASIC(keycode)) {
+        if (pressed) {
+            register_code(keycode);
+        } else {
+            unregister_code(keycode);
+        }
+    } else if (IS_QK_MODS(keycode)) {
+        if (pressed) {
+            register_code16(keycode);
+        } else {
+            unregister_code16(keycode);
+        }
+    } else if (IS_QK_LAYER_TAP(keycode)) {
+        if (record->tap.count > 0) {
+            if (pressed) {
+                register_code(QK_LAYER_TAP_GET_TAP_KEYCODE(keycode));
+            } else {
+                unregister_code(QK_LAYER_TAP_GET_TAP_KEYCODE(keycode));
+            }
+        } else if (pressed) {
+            layer_on(QK_LAYER_TAP_GET_LAYER(keycode));
+        } else {
+            layer_off(QK_LAYER_TAP_GET_LAYER(keycode));
+        }
+    } else if (IS_QK_LAYER_MOD(keycode)) {
+        uint8_t mods = mods_5_to_8(QK_LAYER_MOD_GET_MODS(keycode));
+        if (pressed) {
+            layer_on(QK_LAYER_MOD_GET_LAYER(keycode));
+            register_mods(mods);
+        } else {
+            unregister_mods(mods);
+            layer_off(QK_LAYER_MOD_GET_LAYER(keycode));
+        }
+    } else if (IS_QK_MOMENTARY(keycode)) {
+        if (pressed) {
+            layer_on(QK_MOMENTARY_GET_LAYER(keycode));
+        } else {
+            layer_off(QK_MOMENTARY_GET_LAYER(keycode));
+        }
+    } else if (IS_QK_TOGGLE_LAYER(keycode)) {
+        if (pressed) {
+            layer_invert(QK_TOGGLE_LAYER_GET_LAYER(keycode));
+        }
+    } else if (IS_QK_ONE_SHOT_MOD(keycode)) {
+        uint8_t mods = mods_5_to_8(QK_ONE_SHOT_MOD_GET_MODS(keycode));
+        if (pressed) {
+            oneshot_held_mods   = mods;
+            oneshot_interrupted = false;
+            register_mods(mods);
+        } else {
+            unregister_mods(mods);
+            if (!oneshot_interrupted && oneshot_held_mods == mods) {
+                set_oneshot_mods(get_oneshot_mods() | mods);
+            }
+        }
+    } else if (keycode == QK_BOOT && pressed) {
+        ++bootloader_jumps;
+    }
+}
+
+static void process_record(keyrecord_t *record) {
+    uint16_t keycode = get_record_keycode(record, true);
+
+#ifdef TAP_DANCE_ENABLE
+    if (preprocess_tap_dance(keycode, record)) {
+        // The finished tap dance may have changed the layer state.
+        keycode = get_record_keycode(record, true);
+    }
+#endif
+    if (!process_record_user(keycode, record)) {
+        return;
+    }
+#ifdef TAP_DANCE_ENABLE
+    process_tap_dance(keycode, record);
+#endif
+    process_action(keycode, record);
+}
+
+// Layer tap keys (action_tapping.c)
+// =================================
+
+static keyrecord_t tapping_key;
+static bool        tapping_pending;
+static keyrecord_t waiting_buffer[SIM_MAX_BUFFERED];
+static uint8_t     waiting_count;
+static uint8_t     tap_counts[MATRIX_ROWS][MATRIX_COLS]; // tap count of the held layer tap keys
+static keyrecord_t last_tap;                             // release of the last tapped layer tap key
+static bool        last_tap_valid;
+
+static void tapping_process(keyrecord_t *record);
+
+static uint16_t tapping_keycode(keyrecord_t *record) {
+    return get_record_keycode(record, false);
+}
+
+static void replay_waiting_buffer(keyrecord_t *extra) {
+    keyrecord_t records[SIM_MAX_BUFFERED + 1];
+    uint8_t     count = waiting_count;
+
+    memcpy(records, waiting_buffer, sizeof(keyrecord_t) * count);
+    if (extra) {
+        records[count++] = *extra;
+    }
+    waiting_count = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        tapping_process(&records[i]);
+    }
+}
+
+static void tapping_resolve_hold(void) {
+    tapping_pending       = false;
+    tapping_key.tap.count = 0;
+    process_record(&tapping_key);
+    replay_waiting_buffer(NULL);
+}
+
+static void waiting_buffer_add(keyrecord_t *record) {
+    if (waiting_count >= SIM_MAX_BUFFERED) {
+        fprintf(stderr, "sim: waiting buffer overflow\n");
+        abort();
+    }
+    waiting_buffer[waiting_count++] = *record;
+}
+
+static bool waiting_buffer_has_press(keypos_t key) {
+    for (uint8_t i = 0; i < waiting_count; ++i) {
+        if (waiting_buffer[i].event.pressed && same_key(waiting_buffer[i].event.key, key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tapping_process(keyrecord_t *record) {
+    keypos_t key = record->event.key;
+
+    if (tapping_pending) {
+        if (same_key(key, tapping_key.event.key) && !record->event.pressed) {
+            // Released within the tapping term: tap.
+            tapping_pending       = false;
+            tapping_key.tap.count = 1;
+            tap_counts[key.row][key.col] = 1;
+            process_record(&tapping_key);
+            record->tap.count = 1;
+            replay_waiting_buffer(record);
+        } else if (record->event.pressed) {
+            waiting_buffer_add(record);
+            if (get_hold_on_other_key_press(tapping_keycode(&tapping_key), &tapping_key)) {
+                tapping_resolve_hold();
+            }
+        } else if (waiting_buffer_has_press(key)) {
+            waiting_buffer_add(record);
+        } else {
+            // Release of a key pressed before the tapping key.
+            process_record(record);
+        }
+        return;
+    }
+
+    bool matrix_key = key.row < MATRIX_ROWS && key.col < MATRIX_COLS;
+    if (record->event.pressed) {
+        if (matrix_key && IS_QK_LAYER_TAP(tapping_keycode(record))) {
+            if (last_tap_valid && same_key(key, last_tap.event.key) && TIMER_DIFF_16(record->event.time, last_tap.event.time) < get_tapping_term(tapping_keycode(record), record)) {
+                // Quick tap: the tap keycode is registered while held.
+                tap_counts[key.row][key.col] = 2;
+                record->tap.count            = 2;
+                last_tap_valid               = false;
+                process_record(record);
+                return;
+            }
+            tapping_key     = *record;
+            tapping_pending = true;
+            return;
+        }
+        last_tap_valid = false;
+    } else if (matrix_key && tap_counts[key.row][key.col]) {
+        record->tap.count = tap_counts[key.row][key.col];
+        if (record->tap.count == 1) {
+            last_tap       = *record;
+            last_tap_valid = true;
+        }
+        tap_counts[key.row][key.col] = 0;
+    }
+    process_record(record);
+}
+
+static void tapping_task(void) {
+    // The time of the tick event is rounded the same way as the key event time.
+    if (tapping_pending && TIMER_DIFF_16(timer_read() | 1, tapping_key.event.time) >= get_tapping_term(tapping_keycode(&tapping_key), &tapping_key)) {
+        tapping_resolve_hold();
+    }
+}
+
+// Combos (process_combo.c)
+// ========================
+
+#ifdef COMBO_ENABLE
+enum combo_flags {
+    COMBO_PREPARED = 1 << 0, // all keys pressed, waiting for the combo to fire
+    COMBO_ACTIVE   = 1 << 1, // fired, some keys still held
+    COMBO_RELEASED = 1 << 2, // fired, the combo keycode was released
+    COMBO_DISABLED = 1 << 3, // completed after its combo term
+};
+
+static uint16_t    combo_states[SIM_MAX_COMBOS]; // bit per pressed combo key
+static uint8_t     combo_flags[SIM_MAX_COMBOS];
+static keyrecord_t combo_key_buffer[SIM_MAX_BUFFERED];
+static bool        combo_key_used[SIM_MAX_BUFFERED];
+static uint8_t     combo_key_count;
+static uint16_t    combo_timer;
+static bool        combo_timer_running;
+static uint16_t    combo_longest_term;
+
+static uint16_t combo_term(uint16_t index) {
+#    ifdef COMBO_TERM_PER_COMBO
+    return get_combo_term(index, combo_get(index));
+#    else
+    return COMBO_TERM;
+#    endif
+}
+
+static bool combo_must_hold(uint16_t index) {
+#    ifdef COMBO_MUST_HOLD_PER_COMBO
+    return get_combo_must_hold(index, combo_get(index));
+#    else
+    return false;
+#    endif
+}
+
+static bool combo_must_press_in_order(uint16_t index) {
+#    ifdef COMBO_MUST_PRESS_IN_ORDER_PER_COMBO
+    return get_combo_must_press_in_order(index, combo_get(index));
+#    else
+    return false;
+#    endif
+}
+
+static uint8_t combo_key_total(uint16_t index) {
+    const uint16_t *keys  = combo_get(index)->keys;
+    uint8_t         count = 0;
+    while (pgm_read_word(&keys[count]) != COMBO_END) {
+        ++count;
+    }
+    return count;
+}
+
+static int8_t combo_key_index(uint16_t index, uint16_t keycode) {
+    const uint16_t *keys = combo_get(index)->keys;
+    for (uint8_t i = 0; pgm_read_word(&keys[i]) != COMBO_END; ++i) {
+        if (pgm_read_word(&keys[i]) == keycode) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void combo_event(uint16_t index, bool pressed) {
+    keyrecord_t record = {
+        .event   = {.key = {.row = COMBO_KEY_ROW, .col = COMBO_KEY_ROW}, .time = timer_read() | 1, .type = COMBO_EVENT, .pressed = pressed},
+        .keycode = combo_get(index)->keycode,
+    };
+    tapping_process(&record);
+}
+
+// Forget the partially pressed combos (the active ones are kept).
+static void clear_combos(void) {
+    for (uint16_t i = 0; i < combo_count(); ++i) {
+        if (!(combo_flags[i] & COMBO_ACTIVE)) {
+            combo_states[i] = 0;
+            combo_flags[i]  = 0;
+        }
+    }
+    combo_timer_running = false;
+    combo_longest_term  = 0;
+}
+
+static void dump_key_buffer(void) {
+    keyrecord_t records[SIM_MAX_BUFFERED];
+    uint8_t     count = 0;
+
+    for (uint8_t i = 0; i < combo_key_count; ++i) {
+        if (!combo_key_used[i]) {
+            records[count++] = combo_key_buffer[i];
+        }
+    }
+    combo_key_count = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        tapping_process(&records[i]);
+    }
+}
+
+static bool combo_key_buffered(uint16_t index) {
+    for (uint8_t i = 0; i < combo_key_count; ++i) {
+        if (!combo_key_used[i] && combo_key_index(index, keymap_key_to_keycode(COMBO_ONLY_FROM_LAYER, combo_key_buffer[i].event.key)) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fire the prepared combos, then process the remaining buffered keys.
+static void apply_combos(void) {
+    for (uint16_t i = 0; i < combo_count(); ++i) {
+        if (!(combo_flags[i] & COMBO_PREPARED)) {
+            continue;
+        }
+        combo_flags[i] &= ~COMBO_PREPARED;
+        if (combo_must_hold(i) && timer_elapsed(combo_timer) < COMBO_HOLD_TERM) {
+            continue;
+        }
+        if (!combo_key_buffered(i)) {
+            continue;
+        }
+        for (uint8_t k = 0; k < combo_key_count; ++k) {
+            if (combo_key_index(i, keymap_key_to_keycode(COMBO_ONLY_FROM_LAYER, combo_key_buffer[k].event.key)) >= 0) {
+                combo_key_used[k] = true;
+            }
+        }
+        combo_flags[i] |= COMBO_ACTIVE;
+        combo_event(i, true);
+    }
+    dump_key_buffer();
+    clear_combos();
+}
+
+static bool process_combo(keyrecord_t *record) {
+    if (record->event.type == COMBO_EVENT) {
+        return true;
+    }
+
+    uint16_t keycode      = keymap_key_to_keycode(COMBO_ONLY_FROM_LAYER, record->event.key);
+    bool     is_combo_key = false;
+    bool     prepared     = false;
+
+    for (uint16_t i = 0; i < combo_count(); ++i) {
+        int8_t key_index = combo_key_index(i, keycode);
+        if (key_index < 0) {
+            continue;
+        }
+        uint16_t bit = 1 << key_index;
+        if (record->event.pressed) {
+            if ((combo_flags[i] & (COMBO_ACTIVE | COMBO_DISABLED)) || (combo_must_press_in_order(i) && (combo_states[i] & (bit - 1)) != bit - 1)) {
+                continue;
+            }
+            is_combo_key = true;
+            combo_states[i] |= bit;
+            if (combo_longest_term < combo_term(i)) {
+                combo_longest_term = combo_term(i);
+            }
+            if (combo_states[i] == (1 << combo_key_total(i)) - 1) {
+                if (combo_timer_running && timer_elapsed(combo_timer) > combo_term(i)) {
+                    combo_flags[i] |= COMBO_DISABLED;
+                } else {
+                    combo_flags[i] |= COMBO_PREPARED;
+                    if (combo_must_hold(i) && combo_longest_term < COMBO_HOLD_TERM) {
+                        combo_longest_term = COMBO_HOLD_TERM;
+                    }
+                }
+            }
+        } else if ((combo_flags[i] & COMBO_ACTIVE) && (combo_states[i] & bit)) {
+            // The first released key releases the combo keycode; the releases
+            // of all combo keys are consumed.
+            is_combo_key = true;
+            combo_states[i] &= ~bit;
+            if (!(combo_flags[i] & COMBO_RELEASED)) {
+                combo_flags[i] |= COMBO_RELEASED;
+                combo_event(i, false);
+            }
+            if (combo_states[i] == 0) {
+                combo_flags[i] = 0;
+            }
+        }
+        prepared |= (combo_flags[i] & COMBO_PREPARED) != 0;
+    }
+
+    if (record->event.pressed && is_combo_key) {
+        if (combo_key_count >= SIM_MAX_BUFFERED) {
+            fprintf(stderr, "sim: combo key buffer overflow\n");
+            abort();
+        }
+        combo_key_used[combo_key_count]     = false;
+        combo_key_buffer[combo_key_count++] = *record;
+        combo_timer                         = timer_read();
+        combo_timer_running                 = true;
+        return false;
+    }
+
+    if (combo_key_count > 0) {
+        if (prepared) {
+            apply_combos();
+        } else {
+            dump_key_buffer();
+            clear_combos();
+        }
+        if (!record->event.pressed && !is_combo_key) {
+            // The release may belong to a combo which has just been fired.
+            return process_combo(record);
+        }
+    }
+    return !is_combo_key;
+}
+
+static void combo_task(void) {
+    if (combo_timer_running && timer_elapsed(combo_timer) > combo_longest_term) {
+        bool prepared = false;
+        for (uint16_t i = 0; i < combo_count(); ++i) {
+            prepared |= (combo_flags[i] & COMBO_PREPARED) != 0;
+        }
+        if (prepared) {
+            apply_combos();
+        } else {
+            dump_key_buffer();
+            clear_combos();
+        }
+    }
+}
+#endif
+
+// Backlight and suspend (backlight.c, suspend.c)
+// ==============================================
+
+// The backlight is always enabled at the maximum level.
+static uint8_t backlight_level;
+
+bool is_backlight_enabled(void) {
+    return true;
+}
+
+uint8_t get_backlight_level(void) {
+    return BACKLIGHT_LEVELS;
+}
+
+void backlight_set(uint8_t level) {
+    backlight_level = level;
+}
+
+uint8_t sim_backlight_level(void) {
+    return backlight_level;
+}
+
+__attribute__((weak)) void suspend_wakeup_init_user(void) {}
+__attribute__((weak)) void suspend_power_down_user(void) {}
+
+void sim_suspend(void) {
+    backlight_set(0);
+    suspend_power_down_user();
+}
+
+void sim_wakeup(void) {
+    backlight_set(get_backlight_level());
+    suspend_wakeup_init_user();
+}
+
+// Main loop
+// =========
+
+static void action_exec(keyrecord_t *record) {
+    uint16_t keycode = get_record_keycode(record, true);
+
+    if (!pre_process_record_user(keycode, record)) {
+        return;
+    }
+#ifdef COMBO_ENABLE
+    if (!process_combo(record)) {
+        return;
+    }
+#endif
+    tapping_process(record);
+}
+
+void sim_event(keypos_t key, bool pressed) {
+    matrix_row_t mask = (matrix_row_t)1 << key.col;
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS || ((matrix[key.row] & mask) != 0) == pressed) {
+        fprintf(stderr, "sim: invalid key event %u,%u %c\n", key.row, key.col, pressed ? 'd' : 'u');
+        abort();
+    }
+    matrix[key.row] ^= mask;
+    last_input_activity = now;
+
+    keyrecord_t record = {.event = {.key = key, .time = timer_read() | 1, .type = KEY_EVENT, .pressed = pressed}};
+    action_exec(&record);
+}
+
+void sim_task(void) {
+    tapping_task();
+#ifdef COMBO_ENABLE
+    combo_task();
+#endif
+#ifdef TAP_DANCE_ENABLE
+    tap_dance_task();
+#endif
+    housekeeping_task_user();
+}
+
+void sim_key(keypos_t key, bool pressed) {
+    sim_event(key, pressed);
+    sim_task();
+}
+
+void sim_advance_to(uint32_t time) {
+    while ((int32_t)(time - now) > 0) {
+        ++now;
+        sim_task();
+    }
+}
+
+void sim_advance(uint32_t ms) {
+    sim_advance_to(now + ms);
+}
+
+bool sim_core_pending(void) {
+#ifdef COMBO_ENABLE
+    if (combo_key_count > 0) {
+        return true;
+    }
+#endif
+    return tapping_pending || active_td != 0;
+}
+
+// EEPROM (eeconfig.c)
+// ===================
+
+uint8_t  sim_eeprom_datablock[EECONFIG_USER_DATA_SIZE];
+bool     sim_eeprom_datablock_valid;
+uint32_t sim_eeprom_user;
+uint32_t sim_eeprom_bytes_written;
+
+void sim_eeprom_clear(void) {
+    // The state after eeconfig_init(): the user word is cleared, but the user
+    // datablock is not initialized.
+    memset(sim_eeprom_datablock, 0xff, sizeof(sim_eeprom_datablock));
+    sim_eeprom_datablock_valid = false;
+    sim_eeprom_user            = 0;
+}
+
+static void check_datablock_access(uint32_t offset, uint32_t length) {
+    if (offset > sizeof(sim_eeprom_datablock) || length > sizeof(sim_eeprom_datablock) - offset) {
+        fprintf(stderr, "sim: user datablock access out of range: %u+%u\n", (unsigned)offset, (unsigned)length);
+        abort();
+    }
+}
+
+uint32_t eeconfig_read_user(void) {
+    return sim_eeprom_user;
+}
+
+void eeconfig_update_user(uint32_t val) {
+    sim_eeprom_user = val;
+}
+
+bool eeconfig_is_user_datablock_valid(void) {
+    return sim_eeprom_datablock_valid;
+}
+
+uint32_t eeconfig_read_user_datablock(void *data, uint32_t offset, uint32_t length) {
+    check_datablock_access(offset, length);
+    memcpy(data, &sim_eeprom_datablock[offset], length);
+    return length;
+}
+
+uint32_t eeconfig_update_user_datablock(const void *data, uint32_t offset, uint32_t length) {
+    check_datablock_access(offset, length);
+    for (uint32_t i = 0; i < length; ++i) {
+        uint8_t value = ((const uint8_t *)data)[i];
+        if (sim_eeprom_datablock[offset + i] != value) {
+            sim_eeprom_datablock[offset + i] = value;
+            ++sim_eeprom_bytes_written;
+        }
+    }
+    return length;
+}
+
+void eeconfig_init_user_datablock(void) {
+    memset(sim_eeprom_datablock, 0, sizeof(sim_eeprom_datablock));
+    sim_eeprom_datablock_valid = true;
+}
+
+// Text output and raw HID
+// =======================
+
+char sim_typed[4096];
+char sim_console[4096];
+
+static void append_text(char *buffer, size_t size, const char *text) {
+    size_t length = strlen(buffer);
+    snprintf(buffer + length, size - length, "%s", text);
+}
+
+void send_string(const char *string) {
+    append_text(sim_typed, sizeof(sim_typed), string);
+}
+
+void uprintf(const char *fmt, ...) {
+    char    line[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    append_text(sim_console, sizeof(sim_console), line);
+}
+
+uint8_t  sim_raw_hid_response[RAW_EPSIZE];
+uint32_t sim_raw_hid_responses;
+
+void raw_hid_send(uint8_t *data, uint8_t length) {
+    memset(sim_raw_hid_response, 0, sizeof(sim_raw_hid_response));
+    memcpy(sim_raw_hid_response, data, length < RAW_EPSIZE ? length : RAW_EPSIZE);
+    ++sim_raw_hid_responses;
+}
+
+void sim_raw_hid(uint8_t *data) {
+#ifdef RAW_ENABLE
+    uint8_t packet[RAW_EPSIZE];
+    memcpy(packet, data, sizeof(packet));
+    raw_hid_receive(packet, sizeof(packet));
+#else
+    (void)data;
+    fprintf(stderr, "sim: raw HID is not enabled\n");
+    abort();
+#endif
+}
+
+// Initialization
+// ==============
+
+void sim_init(void) {
+    now = 0;
+    memset(matrix, 0, sizeof(matrix));
+    sim_report_count = 0;
+    memset(&host_keyboard, 0, sizeof(host_keyboard));
+    host_buttons = 0;
+    host_driver  = &sim_host_driver;
+    real_mods = weak_mods = oneshot_mods = 0;
+    memset(&keyboard_report, 0, sizeof(keyboard_report));
+    memset(&last_report, 0, sizeof(last_report));
+    memset(&mouse_report, 0, sizeof(mouse_report));
+    memset(source_layers, 0, sizeof(source_layers));
+    active_td        = 0;
+    bootloader_jumps = 0;
+    backlight_level  = BACKLIGHT_LEVELS;
+    tapping_pending  = false;
+    waiting_count    = 0;
+    last_tap_valid   = false;
+    memset(tap_counts, 0, sizeof(tap_counts));
+#ifdef COMBO_ENABLE
+    memset(combo_states, 0, sizeof(combo_states));
+    memset(combo_flags, 0, sizeof(combo_flags));
+    combo_key_count     = 0;
+    combo_timer_running = false;
+    combo_longest_term  = 0;
+#endif
+    sim_typed[0]          = '\0';
+    sim_console[0]        = '\0';
+    sim_raw_hid_responses = 0;
+    last_input_activity   = now;
+
+    layer_state         = 0;
+    default_layer_state = default_layer_state_set_user(1);
+    keyboard_post_init_user();
+    sim_task();
+}
@@ -0,0 +1,108 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Model of the QMK core for running the keymap natively (see sim.c).
+
+#pragma once
+
+#include "quantum.h"
+
+// Reports received by the host (in the order of sending).
+typedef enum {
+    SIM_REPORT_KEYBOARD,
+    SIM_REPORT_NKRO,
+    SIM_REPORT_MOUSE,
+    SIM_REPORT_EXTRA,
+} sim_report_type_t;
+
+typedef struct {
+    uint32_t          time;
+    sim_report_type_t type;
+    uint8_t           mods;                       // keyboard and NKRO reports
+    uint8_t           keys[KEYBOARD_REPORT_KEYS]; // keyboard reports
+    uint8_t           buttons;                    // mouse reports
+    uint16_t          usage;                      // extra reports
+} sim_report_t;
+
+#define SIM_MAX_REPORTS 65536
+
+extern sim_report_t sim_reports[SIM_MAX_REPORTS];
+extern uint32_t     sim_report_count;
+
+// Reset the whole model state except the EEPROM contents, then start the
+// keyboard (calls keyboard_post_init_user() and runs the tasks once).
+void sim_init(void);
+
+// Current time (ms).
+uint32_t sim_now(void);
+
+// Run the main loop for the specified time (the tasks run once per ms).
+void sim_advance(uint32_t ms);
+
+// Run the main loop until the specified time (does nothing if that time has
+// already passed, e.g., because of a wait in the keymap code).
+void sim_advance_to(uint32_t time);
+
+// Suspend or resume the keyboard as on a USB suspend or resume (the core
+// turns the lighting off or back on, then calls suspend_power_down_user() or
+// suspend_wakeup_init_user()).
+void sim_suspend(void);
+void sim_wakeup(void);
+
+// Process a key event at the current time (one main loop iteration: the event
+// and then the tasks).
+void sim_key(keypos_t key, bool pressed);
+
+// Process a key event without running the tasks (several events can be
+// processed in the same main loop iteration by calling this function several
+// times and then sim_task()).
+void sim_event(keypos_t key, bool pressed);
+
+// Run the tasks of one main loop iteration.
+void sim_task(void);
+
+// Host state after all received reports.
+uint8_t sim_host_mods(void);
+bool    sim_host_key(uint8_t keycode);
+uint8_t sim_host_buttons(void);
+bool    sim_host_idle(void); // no keys, modifiers or buttons
+
+// Number of presses of the key seen by the host (keyboard report transitions
+// from released to pressed) in the reports starting from index `start`.
+uint32_t sim_host_presses(uint32_t start, uint8_t keycode);
+
+// Same as sim_host_presses(), but only the presses with exactly the specified
+// modifiers (in the same report) are counted.
+uint32_t sim_host_chords(uint32_t start, uint8_t keycode, uint8_t mods);
+
+// Forget the received reports (the host state is kept).
+void sim_reports_clear(void);
+
+// Model state checks.
+uint8_t sim_real_mods(void);
+uint8_t sim_weak_mods(void);
+bool    sim_keys_pressed(void);  // any physical keys still pressed
+bool    sim_core_pending(void);  // buffered events or an unfinished tap dance
+uint32_t sim_bootloader_jumps(void);
+uint8_t  sim_backlight_level(void); // the level set by the last backlight_set() call
+
+// EEPROM contents (kept by sim_init()).
+extern uint8_t  sim_eeprom_datablock[EECONFIG_USER_DATA_SIZE];
+extern bool     sim_eeprom_datablock_valid;
+extern uint32_t sim_eeprom_user;
+extern uint32_t sim_eeprom_bytes_written;
+
+// Reset the EEPROM to the state after eeconfig_init().
+void sim_eeprom_clear(void);
+
+// Text typed with send_string() and printed to the console.
+extern char sim_typed[4096];
+extern char sim_console[4096];
+
+// Last raw HID packet sent by the keyboard.
+extern uint8_t sim_raw_hid_response[RAW_EPSIZE];
+extern uint32_t sim_raw_hid_responses;
+
+// Send a raw HID packet to the keyboard (the response is in
+// `sim_raw_hid_response`).
+void sim_raw_hid(uint8_t *data);
@@ -0,0 +1,85 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "test.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_TESTS 256
+
+static struct {
+    const char *name;
+    test_fn_t   fn;
+} tests[MAX_TESTS];
+
+static unsigned test_count;
+static unsigned failures;
+
+void test_register(const char *name, test_fn_t fn) {
+    if (test_count >= MAX_TESTS) {
+        fprintf(stderr, "too many tests\n");
+        exit(2);
+    }
+    tests[test_count].name = name;
+    tests[test_count].fn   = fn;
+    ++test_count;
+}
+
+void test_fail(const char *file, int line, const char *format, ...) {
+    va_list args;
+    fprintf(stderr, "%s:%d: ", file, line);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, " (at %u ms)\n", (unsigned)sim_now());
+    ++failures;
+}
+
+static bool run_test(unsigned index) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(2);
+    }
+    if (pid == 0) {
+        sim_eeprom_clear();
+        sim_init();
+        tests[index].fn();
+        fflush(stdout);
+        fflush(stderr);
+        _exit(failures ? 1 : 0);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        exit(2);
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Usage: <test binary> [test name...] (all tests by default).
+int main(int argc, char **argv) {
+    unsigned run    = 0;
+    unsigned failed = 0;
+
+    for (unsigned i = 0; i < test_count; ++i) {
+        bool selected = argc < 2;
+        for (int arg = 1; arg < argc; ++arg) {
+            selected |= strcmp(argv[arg], tests[i].name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        ++run;
+        if (!run_test(i)) {
+            printf("FAIL %s\n", tests[i].name);
+            ++failed;
+        }
+    }
+    printf("%s: %u tests, %u failed\n", argv[0], run, failed);
+    return failed ? 1 : 0;
+}
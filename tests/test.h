@@ -0,0 +1,40 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Minimal test framework for the native tests.  Every test case runs in a
+// separate process with the model state reset (the EEPROM is erased and
+// sim_init() is called), so that a crash or a leftover state in one test case
+// does not affect the others.  The CHECK macros report the failures and let
+// the test case continue.
+
+#pragma once
+
+#include "sim.h"
+
+typedef void (*test_fn_t)(void);
+
+void test_register(const char *name, test_fn_t fn);
+void test_fail(const char *file, int line, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define TEST(name)                                                    \
+    static void name(void);                                           \
+    __attribute__((constructor)) static void register_##name(void) { \
+        test_register(#name, name);                                   \
+    }                                                                 \
+    static void name(void)
+
+#define CHECK(condition)                                           \
+    do {                                                           \
+        if (!(condition)) {                                        \
+            test_fail(__FILE__, __LINE__, "CHECK(%s)", #condition); \
+        }                                                          \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                                                        \
+    do {                                                                                                                                  \
+        long long actual_value_   = (long long)(actual);                                                                                  \
+        long long expected_value_ = (long long)(expected);                                                                                \
+        if (actual_value_ != expected_value_) {                                                                                           \
+            test_fail(__FILE__, __LINE__, "CHECK_EQ(%s, %s): %lld != %lld", #actual, #expected, actual_value_, expected_value_); \
+        }                                                                                                                                 \
+    } while (0)
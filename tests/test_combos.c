@@ -0,0 +1,172 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Combos (`key_combos[]`) and the delay which they add to the combo keys.
+
+#include "keymap_test.h"
+
+// Time of the first host report after `start` (UINT32_MAX if none).
+static uint32_t first_report_time(uint32_t start) {
+    return start < sim_report_count ? sim_reports[start].time : UINT32_MAX;
+}
+
+TEST(ins_pgup_sends_ctrl_pgup) {
+    uint32_t start = sim_report_count;
+
+    press(LP_INS);
+    sim_advance(5);
+    press(LP_PGUP);
+    sim_advance(50);
+    release(LP_PGUP);
+    release(LP_INS);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_PGUP, MOD_BIT(KC_RCTL)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_INS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(ins_pgdn_sends_ctrl_pgdn) {
+    uint32_t start = sim_report_count;
+
+    press(LP_INS);
+    sim_advance(5);
+    press(LP_PGDN);
+    sim_advance(50);
+    release(LP_PGDN);
+    release(LP_INS);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_PGDN, MOD_BIT(KC_RCTL)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_INS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(ins_1_and_ins_2_select_lang_switch_modes) {
+    user_config.lang_switch_mode = LSW_MODE_GUI_SPACE;
+    uint32_t start               = sim_report_count;
+
+    press(LP_INS);
+    sim_advance(5);
+    press(LP_1);
+    sim_advance(50);
+    release(LP_INS);
+    release(LP_1);
+    settle();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CAPS);
+
+    press(LP_INS);
+    sim_advance(5);
+    press(LP_2);
+    sim_advance(50);
+    release(LP_2);
+    release(LP_INS);
+    settle();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CTRL_F15);
+    CHECK_EQ(sim_report_count, start);
+}
+
+TEST(held_ins_del_jumps_to_bootloader) {
+    press(LP_INS);
+    sim_advance(COMBO_TERM + 10);
+    press(LP_DEL);
+    sim_advance(COMBO_HOLD_TERM + 10);
+    CHECK_EQ(sim_bootloader_jumps(), 1);
+    release(LP_DEL);
+    release(LP_INS);
+    settle();
+}
+
+TEST(short_ins_del_press_is_not_a_bootloader_jump) {
+    uint32_t start = sim_report_count;
+
+    press(LP_INS);
+    sim_advance(5);
+    press(LP_DEL);
+    sim_advance(100);
+    release(LP_DEL);
+    release(LP_INS);
+    settle();
+
+    CHECK_EQ(sim_bootloader_jumps(), 0);
+    CHECK_EQ(sim_host_presses(start, KC_INS), 1);
+    CHECK_EQ(sim_host_presses(start, KC_DEL), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(single_combo_key_is_sent_after_combo_term) {
+    uint32_t start = sim_report_count;
+
+    // Ins is delayed by the longest term of the combos which it starts.
+    press(LP_INS);
+    sim_advance(COMBO_TERM * 2 + 5);
+    CHECK(sim_host_key(KC_INS));
+    CHECK(first_report_time(start) <= COMBO_TERM * 2 + 1);
+    release(LP_INS);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_INS, 0), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(combo_key_tap_is_not_lost) {
+    uint32_t start = sim_report_count;
+
+    tap_hold(LP_INS, 10, 10);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_INS), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(late_second_key_is_not_a_combo) {
+    uint32_t start = sim_report_count;
+
+    press(LP_INS);
+    sim_advance(COMBO_TERM * 2 + 20);
+    press(LP_PGUP);
+    sim_advance(COMBO_TERM + 20);
+    release(LP_PGUP);
+    release(LP_INS);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_INS, 0), 1);
+    CHECK_EQ(sim_host_chords(start, KC_PGUP, 0), 1);
+    CHECK_EQ(sim_host_presses(start, KC_RCTL), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(combo_in_reverse_order_is_not_a_combo) {
+    uint32_t start = sim_report_count;
+    uint32_t now   = sim_now();
+
+    press(LP_PGUP);
+    CHECK_EQ(first_report_time(start), now);
+    sim_advance(5);
+    press(LP_INS);
+    sim_advance(50);
+    release(LP_INS);
+    release(LP_PGUP);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_PGUP, 0), 1);
+    CHECK_EQ(sim_host_presses(start, KC_INS), 1);
+    CHECK_EQ(sim_host_presses(start, KC_RCTL), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(other_keys_are_not_delayed) {
+    for (uint8_t position = LP_GRV; position <= LP_RGHT; ++position) {
+        keypos_t key     = key_at(position);
+        uint16_t keycode = keymap_key_to_keycode(_QWERTY, key);
+        if (!IS_QK_BASIC(keycode) || keycode == KC_INS) {
+            continue;
+        }
+        uint32_t start = sim_report_count;
+        uint32_t now   = sim_now();
+        press(position);
+        CHECK_EQ(first_report_time(start), now);
+        release(position);
+        settle();
+    }
+}
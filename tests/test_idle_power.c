@@ -0,0 +1,101 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Idle mode (idle_power.c).
+
+#include "keymap_test.h"
+
+// Same defaults as in idle_power.c.
+#ifndef IDLE_TIMEOUT_DEFAULT
+#    define IDLE_TIMEOUT_DEFAULT 10
+#endif
+#ifndef IDLE_SCAN_DELAY
+#    define IDLE_SCAN_DELAY 10
+#endif
+
+#define MINUTE 60000UL
+
+TEST(idle_after_default_timeout) {
+    sim_advance(IDLE_TIMEOUT_DEFAULT * MINUTE - 100);
+    CHECK(!idle_power_is_idle());
+    sim_advance(200);
+    CHECK(idle_power_is_idle());
+}
+
+TEST(idle_timeout_setting) {
+    user_config.idle_timeout = 2;
+    sim_advance(2 * MINUTE + 100);
+    CHECK(idle_power_is_idle());
+
+    tap(LP_J);
+    CHECK(!idle_power_is_idle());
+    user_config.idle_timeout = IDLE_TIMEOUT_NEVER;
+    sim_advance(60 * MINUTE);
+    CHECK(!idle_power_is_idle());
+}
+
+TEST(first_press_in_idle_mode_is_not_lost) {
+    sim_advance(IDLE_TIMEOUT_DEFAULT * MINUTE + 1000);
+    CHECK(idle_power_is_idle());
+
+    for (uint32_t offset = 0; offset < IDLE_SCAN_DELAY * 2; ++offset) {
+        sim_advance(IDLE_TIMEOUT_DEFAULT * MINUTE + 1000 + offset);
+        CHECK(idle_power_is_idle());
+
+        // The key is pressed at `pressed`, but is seen only by the first matrix
+        // scan after the idle sleep.
+        uint32_t start   = sim_report_count;
+        uint32_t pressed = sim_now() + offset;
+        sim_advance_to(pressed);
+        press(LP_J);
+        CHECK(!idle_power_is_idle());
+        CHECK_EQ(sim_host_presses(start, KC_J), 1);
+        CHECK(sim_reports[start].time - pressed <= IDLE_SCAN_DELAY);
+        release(LP_J);
+    }
+}
+
+TEST(idle_key_cycles_timeouts) {
+    static const uint8_t timeouts[] = {5, 30, IDLE_TIMEOUT_NEVER, 0, 5};
+
+    user_config.idle_timeout = 0;
+    layer_on(_ADJUST);
+    for (uint8_t i = 0; i < ARRAY_SIZE(timeouts); ++i) {
+        tap(LP_6);
+        CHECK_EQ(user_config.idle_timeout, timeouts[i]);
+    }
+
+    // A timeout set by raw HID selects the first one in the list.
+    user_config.idle_timeout = 7;
+    tap(LP_6);
+    CHECK_EQ(user_config.idle_timeout, 0);
+    layer_off(_ADJUST);
+    settle();
+    CHECK_EQ(sim_report_count, 0);
+}
+
+#ifdef BACKLIGHT_ENABLE
+TEST(lighting_stays_off_after_resume_while_idle) {
+    sim_advance(IDLE_TIMEOUT_DEFAULT * MINUTE + 1000);
+    CHECK(idle_power_is_idle());
+    CHECK_EQ(sim_backlight_level(), 0);
+
+    sim_suspend();
+    sim_advance(1000);
+    sim_wakeup();
+    sim_advance(100);
+    CHECK(idle_power_is_idle());
+    CHECK_EQ(sim_backlight_level(), 0);
+
+    tap(LP_J);
+    CHECK(!idle_power_is_idle());
+    CHECK_EQ(sim_backlight_level(), BACKLIGHT_LEVELS);
+}
+
+TEST(lighting_is_on_after_resume_while_active) {
+    sim_suspend();
+    sim_wakeup();
+    CHECK(!idle_power_is_idle());
+    CHECK_EQ(sim_backlight_level(), BACKLIGHT_LEVELS);
+}
+#endif
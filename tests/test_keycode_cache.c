@@ -0,0 +1,68 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Keycode cache in keymap_key_to_keycode(): the cached lookups must match the
+// uncached layer walk for all layer states, also after keymap overrides are
+// changed.
+
+#include "keymap_test.h"
+
+// Keycode of the key on the highest active non-transparent layer, without the
+// cache.
+static uint16_t reference_keycode(keypos_t key) {
+    layer_state_t layers = layer_state | default_layer_state;
+    for (uint8_t layer = ARRAY_SIZE(keymaps); layer-- > 0;) {
+        if ((layers & ((layer_state_t)1 << layer)) && get_layer_keycode(layer, key) != KC_TRNS) {
+            return get_layer_keycode(layer, key);
+        }
+    }
+    return get_layer_keycode(0, key);
+}
+
+static void check_all_layer_states(void) {
+    for (layer_state_t state = 0; state < ((layer_state_t)1 << ARRAY_SIZE(keymaps)); ++state) {
+        layer_state_set(state);
+        for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+            for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+                keypos_t key = {.row = row, .col = col};
+                // Twice: the first lookup fills the cache entry.
+                CHECK_EQ(keymap_key_to_keycode(layer_switch_get_layer(key), key), reference_keycode(key));
+                CHECK_EQ(keymap_key_to_keycode(layer_switch_get_layer(key), key), reference_keycode(key));
+                for (uint8_t layer = 0; layer < ARRAY_SIZE(keymaps); ++layer) {
+                    uint16_t keycode = keymap_key_to_keycode(layer, key);
+                    CHECK(keycode == get_layer_keycode(layer, key) || (keycode == KC_TRNS && layer > layer_switch_get_layer(key)));
+                }
+            }
+        }
+    }
+    layer_clear();
+}
+
+TEST(cache_matches_layer_walk) {
+    check_all_layer_states();
+}
+
+TEST(cache_is_invalidated_by_overrides) {
+    check_all_layer_states();
+    CHECK(keymap_override_set(_FN, LP_J, KC_F13));
+    CHECK(keymap_override_set(_NUMPAD, LP_J, KC_TRNS));
+    CHECK(keymap_override_set(_QWERTY, LP_K, KC_F14));
+    keycode_cache_invalidate();
+    check_all_layer_states();
+}
+
+TEST(held_key_keeps_its_layer) {
+    uint32_t start = sim_report_count;
+
+    press(LP_ESC);
+    sim_advance(TAPPING_TERM + 10);
+    press(LP_J);
+    release(LP_ESC);
+    CHECK(sim_host_key(KC_LEFT));
+    release(LP_J);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_LEFT), 1);
+    CHECK_EQ(sim_host_presses(start, KC_J), 0);
+    CHECK(sim_host_idle());
+}
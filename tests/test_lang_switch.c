@@ -0,0 +1,191 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Language switch: the chords for every mode, double taps of the Shift tap
+// dances and the U_LSW key.
+
+#include "keymap_test.h"
+
+static void set_mode(uint8_t mode) {
+    user_config.lang_switch_mode = mode;
+}
+
+TEST(lshift_double_tap_sends_caps_lock) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    tap(LP_LSFT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_CAPS, 0), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(caps_lock_is_held_for_tap_hold_caps_delay) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    tap(LP_LSFT);
+    settle();
+
+    uint32_t pressed = 0, released = 0;
+    bool     down    = false;
+    for (uint32_t i = start; i < sim_report_count; ++i) {
+        bool caps = memchr(sim_reports[i].keys, KC_CAPS, KEYBOARD_REPORT_KEYS) != NULL;
+        if (caps && !down) {
+            pressed = sim_reports[i].time;
+        } else if (!caps && down) {
+            released = sim_reports[i].time;
+        }
+        down = caps;
+    }
+    CHECK(released - pressed >= TAP_HOLD_CAPS_DELAY);
+}
+
+TEST(rshift_double_tap_adds_right_shift) {
+    set_mode(LSW_MODE_CTRL_F15);
+    uint32_t start = sim_report_count;
+
+    tap(LP_RSFT);
+    tap(LP_RSFT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_F15, MOD_BIT(KC_LCTL) | MOD_BIT(KC_RSFT)), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(chords_for_all_modes) {
+    static const struct {
+        uint8_t mode;
+        uint8_t key; // key in the chord (or the last modifier)
+        uint8_t mods;
+    } chords[] = {
+        {LSW_MODE_CAPS, KC_CAPS, 0},
+        {LSW_MODE_CTRL_F15, KC_F15, MOD_BIT(KC_LCTL)},
+        {LSW_MODE_ALT_SHIFT, KC_LALT, MOD_BIT(KC_LALT) | MOD_BIT(KC_LSFT)},
+        {LSW_MODE_CTRL_SHIFT, KC_LCTL, MOD_BIT(KC_LCTL) | MOD_BIT(KC_LSFT)},
+        {LSW_MODE_GUI_SPACE, KC_SPC, MOD_BIT(KC_LGUI)},
+    };
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(chords); ++i) {
+        set_mode(chords[i].mode);
+        uint32_t start = sim_report_count;
+
+        tap(LP_LSFT);
+        tap(LP_LSFT);
+        settle();
+
+        // The whole chord is sent in a single report.
+        CHECK_EQ(sim_host_chords(start, chords[i].key, chords[i].mods), 1);
+        CHECK(sim_host_idle());
+    }
+}
+
+TEST(lsw_key_on_fn_layer) {
+    uint32_t start = sim_report_count;
+
+    press(LP_ESC);
+    sim_advance(TAPPING_TERM + 10);
+    press(LP_TAB);
+    CHECK(sim_host_key(KC_CAPS));
+    release(LP_TAB);
+    release(LP_ESC);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_CAPS, 0), 1);
+    CHECK_EQ(sim_host_presses(start, KC_TAB), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(no_switch_on_single_tap_or_hold) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    settle();
+    tap_hold(LP_LSFT, TAPPING_TERM + 50, 20);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(no_switch_on_tap_then_hold) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    tap_hold(LP_LSFT, TAPPING_TERM + 50, 20);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(no_switch_on_triple_tap) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    tap(LP_LSFT);
+    tap(LP_LSFT);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(no_switch_when_typing_between_taps) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    tap(LP_J);
+    tap(LP_LSFT);
+    settle();
+
+    // Shift+J followed by a Shift tap; the second tap starts a new dance.
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(no_switch_when_fn_is_pressed_during_second_tap) {
+    uint32_t start = sim_report_count;
+
+    // The U_FESC press is held in the tapping buffer while the tap dance is
+    // still running, and the tap dance finishes before the Fn layer does.
+    tap(LP_LSFT);
+    press(LP_LSFT);
+    sim_advance(20);
+    press(LP_ESC);
+    sim_advance(10);
+    release(LP_LSFT);
+    sim_advance(TAPPING_TERM);
+    release(LP_ESC);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(no_switch_when_other_shift_is_tapped) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    tap(LP_RSFT);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(shifted_letter_during_double_tap_hold) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_LSFT);
+    press(LP_LSFT);
+    sim_advance(20);
+    tap(LP_A);
+    release(LP_LSFT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_A, MOD_BIT(KC_LSFT)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
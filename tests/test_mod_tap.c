@@ -0,0 +1,156 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Modifier keys with actions on multiple taps (`mod_tap_actions[]`): U_RALTG
+// on the base layer and U_LSFTL (put on the Left Shift position with a keymap
+// override).
+
+#include "keymap_test.h"
+
+static void override_key(uint8_t layer, uint8_t position, uint16_t keycode) {
+    CHECK(keymap_override_set(layer, position, keycode));
+    keycode_cache_invalidate();
+}
+
+TEST(raltg_hold_is_ralt_without_delay) {
+    uint32_t start = sim_report_count;
+
+    press(LP_RALT);
+    CHECK(sim_host_key(KC_RALT));
+    sim_advance(TAPPING_TERM * 2);
+    tap(LP_J);
+    release(LP_RALT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_J, MOD_BIT(KC_RALT)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_RGUI), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(raltg_double_tap_is_rgui) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RALT);
+    press(LP_RALT);
+    CHECK(sim_host_key(KC_RGUI));
+    CHECK(!sim_host_key(KC_RALT));
+    tap(LP_J);
+    release(LP_RALT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_J, MOD_BIT(KC_RGUI)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_RGUI), 1);
+    // The first tap has already sent Right Alt.
+    CHECK_EQ(sim_host_presses(start, KC_RALT), 1);
+    CHECK(sim_host_idle());
+}
+
+// Return true if the host received a report with exactly the specified
+// modifiers starting from index `start`.
+static bool host_saw_mods(uint32_t start, uint8_t mods) {
+    for (uint32_t i = start; i < sim_report_count; ++i) {
+        if (sim_reports[i].type == SIM_REPORT_KEYBOARD && sim_reports[i].mods == mods) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(raltg_lone_tap_is_neutralized) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RALT);
+    settle();
+
+    CHECK(host_saw_mods(start, MOD_BIT(KC_RALT) | MOD_BIT(MOD_TAP_NEUTRALIZER)));
+    CHECK(sim_host_idle());
+
+    start = sim_report_count;
+    press(LP_RALT);
+    tap(LP_J);
+    release(LP_RALT);
+    settle();
+
+    CHECK(!host_saw_mods(start, MOD_BIT(KC_RALT) | MOD_BIT(MOD_TAP_NEUTRALIZER)));
+}
+
+#ifdef KEY_STATS_ENABLE
+TEST(raltg_taps_are_counted) {
+    tap(LP_RALT);
+    settle();
+    tap(LP_RALT);
+    tap(LP_RALT);
+    settle();
+    tap(LP_RALT);
+    tap(LP_RALT);
+    tap(LP_RALT);
+    settle();
+
+    key_stats_counter_t data[KEY_STATS_EVENTS];
+    key_stats_read((KEY_STATS_LAYERS * KEY_STATS_POSITIONS + KEY_STATS_POSITIONS) * sizeof(data[0]), (uint8_t *)data, sizeof(data));
+    CHECK_EQ(data[KEY_STATS_RALTG], 3);
+    CHECK_EQ(data[KEY_STATS_RALTG + 1], 2);
+    CHECK_EQ(data[KEY_STATS_RALTG + 2], 1);
+}
+#endif
+
+TEST(raltg_triple_tap_is_rgui_ralt) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RALT);
+    tap(LP_RALT);
+    press(LP_RALT);
+    tap(LP_J);
+    release(LP_RALT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_J, MOD_BIT(KC_RGUI) | MOD_BIT(KC_RALT)), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(raltg_slow_double_tap_is_ralt) {
+    uint32_t start = sim_report_count;
+
+    tap_hold(LP_RALT, 20, TAPPING_TERM + 10);
+    press(LP_RALT);
+    CHECK(sim_host_key(KC_RALT));
+    release(LP_RALT);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_RALT), 2);
+    CHECK_EQ(sim_host_presses(start, KC_RGUI), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(raltg_other_key_restarts_tap_count) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RALT);
+    tap(LP_J);
+    press(LP_RALT);
+    CHECK(sim_host_key(KC_RALT));
+    release(LP_RALT);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_RGUI), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(lsftl_double_tap_switches_language) {
+    override_key(_QWERTY, LP_LSFT, U_LSFTL);
+    uint32_t start = sim_report_count;
+
+    press(LP_LSFT);
+    CHECK(sim_host_key(KC_LSFT));
+    tap(LP_A);
+    release(LP_LSFT);
+    sim_advance(TAPPING_TERM + 10);
+    CHECK_EQ(sim_host_chords(start, KC_A, MOD_BIT(KC_LSFT)), 1);
+
+    start = sim_report_count;
+    tap(LP_LSFT);
+    tap(LP_LSFT);
+    settle();
+    CHECK_EQ(sim_host_chords(start, KC_CAPS, 0), 1);
+    CHECK(sim_host_idle());
+}
@@ -0,0 +1,185 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Raw HID protocol (`raw_hid_receive()` in keymap.c).
+
+#include "keymap_test.h"
+
+#ifdef RAW_ENABLE
+static void request(uint8_t command, uint8_t arg1, uint8_t arg2, uint8_t arg3, uint8_t arg4) {
+    uint8_t data[RAW_EPSIZE] = {command, arg1, arg2, arg3, arg4};
+    sim_raw_hid(data);
+}
+
+static uint16_t response_le16(uint8_t offset) {
+    return sim_raw_hid_response[offset] | (sim_raw_hid_response[offset + 1] << 8);
+}
+
+TEST(config_info) {
+    request(RAW_HID_CONFIG_INFO, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_CONFIG_INFO);
+    CHECK_EQ(response_le16(1), sizeof(user_config_t));
+    CHECK_EQ(sim_raw_hid_response[3], MATRIX_ROWS);
+    CHECK_EQ(sim_raw_hid_response[4], MATRIX_COLS);
+}
+
+TEST(config_write_is_validated) {
+    request(RAW_HID_CONFIG_WRITE, offsetof(user_config_t, lang_switch_mode), 0, 1, LSW_MODE_COUNT);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CAPS);
+
+    request(RAW_HID_CONFIG_WRITE, offsetof(user_config_t, lang_switch_mode), 0, 1, LSW_MODE_GUI_SPACE);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_CONFIG_WRITE);
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_GUI_SPACE);
+
+    request(RAW_HID_CONFIG_READ, offsetof(user_config_t, lang_switch_mode), 0, 1, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_CONFIG_READ);
+    CHECK_EQ(sim_raw_hid_response[4], LSW_MODE_GUI_SPACE);
+
+    request(RAW_HID_CONFIG_READ, sizeof(user_config_t) & 0xff, sizeof(user_config_t) >> 8, 1, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+}
+
+TEST(keycode_override_changes_the_keymap) {
+    uint32_t start = sim_report_count;
+
+    request(RAW_HID_KEYCODE_WRITE, _QWERTY, LP_J, KC_K, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_KEYCODE_WRITE);
+    request(RAW_HID_KEYCODE_READ, _QWERTY, LP_J, 0, 0);
+    CHECK_EQ(response_le16(3), KC_K);
+    tap(LP_J);
+    CHECK_EQ(sim_host_presses(start, KC_K), 1);
+    CHECK_EQ(sim_host_presses(start, KC_J), 0);
+
+    request(RAW_HID_KEYCODE_RESET, _QWERTY, LP_J, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_KEYCODE_RESET);
+    start = sim_report_count;
+    tap(LP_J);
+    CHECK_EQ(sim_host_presses(start, KC_J), 1);
+}
+
+TEST(keycode_targets_are_validated) {
+    request(RAW_HID_KEYCODE_WRITE, _ADJUST + 1, LP_J, KC_K, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+    request(RAW_HID_KEYCODE_WRITE, _QWERTY, LP_RGHT + 1, KC_K, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+    request(RAW_HID_KEYCODE_READ, KEYMAP_OVERRIDE_TAP_DANCE | TD_LSFT, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+}
+
+TEST(unknown_command_is_an_error) {
+    request(0x7f, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+    CHECK_EQ(sim_raw_hid_responses, 1);
+}
+
+#    ifdef EVENT_TRACE_ENABLE
+TEST(event_trace_drain) {
+    press(LP_ESC);
+    sim_advance(10);
+    press(LP_J);
+    sim_advance(10);
+    release(LP_J);
+    release(LP_ESC);
+
+    request(RAW_HID_EVENT_TRACE_READ, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_EVENT_TRACE_READ);
+    CHECK_EQ(sim_raw_hid_response[1], 3);
+    CHECK_EQ(sim_raw_hid_response[2], 0);
+
+    const uint8_t *record = &sim_raw_hid_response[3];
+    CHECK_EQ(record[0] | (record[1] << 8), 0 | 1);
+    CHECK_EQ(record[2] | (record[3] << 8), U_FESC);
+    CHECK_EQ(record[4], 1);
+    record += EVENT_TRACE_RECORD_SIZE;
+    CHECK_EQ(record[0] | (record[1] << 8), 10 | 1);
+    CHECK_EQ(record[2] | (record[3] << 8), KC_J);
+    CHECK_EQ(record[4], 1);
+    record += EVENT_TRACE_RECORD_SIZE;
+    // The layer state is recorded before the event is processed; the Fn
+    // layer was activated by the J press.
+    CHECK_EQ(record[2] | (record[3] << 8), KC_LEFT);
+    CHECK_EQ(record[4], 0);
+    CHECK_EQ(record[5] | (record[6] << 8) | (record[7] << 16) | ((uint32_t)record[8] << 24), 1 << _FN);
+
+    request(RAW_HID_EVENT_TRACE_READ, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[1], 1);
+    CHECK_EQ(sim_raw_hid_response[3 + 2] | (sim_raw_hid_response[3 + 3] << 8), U_FESC);
+
+    request(RAW_HID_EVENT_TRACE_READ, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[1], 0);
+}
+
+TEST(event_trace_reports_dropped_records) {
+    for (int i = 0; i < 40; ++i) {
+        tap(LP_J);
+    }
+    request(RAW_HID_EVENT_TRACE_READ, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[1], 3);
+    CHECK_EQ(sim_raw_hid_response[2], 80 - 32);
+}
+#    endif
+
+#    ifdef LATENCY_STATS_ENABLE
+static uint32_t response_le32(uint8_t offset) {
+    return response_le16(offset) | ((uint32_t)response_le16(offset + 2) << 16);
+}
+
+TEST(latency_stats_summary) {
+    tap(LP_J);
+    press(LP_J);
+    sim_advance(1);
+    release(LP_J);
+    sim_advance(1000);
+
+    request(RAW_HID_LATENCY_STATS_READ, LATENCY_STATS_EVENT_DELAY, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_LATENCY_STATS_READ);
+    CHECK_EQ(sim_raw_hid_response[1], LATENCY_STATS_EVENT_DELAY);
+    CHECK(response_le16(2) > 0);
+    CHECK_EQ(response_le32(4), 4);  // count
+    CHECK_EQ(response_le32(8), 0);  // min
+    CHECK_EQ(response_le32(12), 0); // average
+    CHECK_EQ(response_le32(16), 0); // p99
+    CHECK_EQ(response_le32(20), 0); // max
+
+    request(RAW_HID_LATENCY_STATS_READ, LATENCY_STATS_HISTOGRAMS, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_ERROR);
+
+    request(RAW_HID_LATENCY_STATS_RESET, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[0], RAW_HID_LATENCY_STATS_RESET);
+    request(RAW_HID_LATENCY_STATS_READ, LATENCY_STATS_PROCESSING_TIME, 0, 0, 0);
+    CHECK_EQ(response_le32(4), 0);
+}
+#    endif
+
+#    ifdef KEY_STATS_ENABLE
+TEST(key_stats_count_presses) {
+    request(RAW_HID_KEY_STATS_INFO, 0, 0, 0, 0);
+    CHECK_EQ(sim_raw_hid_response[1], KEY_STATS_LAYERS);
+    CHECK_EQ(sim_raw_hid_response[2], KEY_STATS_POSITIONS);
+    CHECK_EQ(sim_raw_hid_response[3], KEY_STATS_EVENTS);
+    CHECK_EQ(sim_raw_hid_response[4], 2);
+
+    tap(LP_J);
+    tap(LP_J);
+    tap(LP_J);
+    request(RAW_HID_KEY_STATS_READ, 2 * (LP_J - 1), 0, 0, 0);
+    CHECK_EQ(response_le16(3), 3);
+
+    request(RAW_HID_KEY_STATS_RESET, 0, 0, 0, 0);
+    request(RAW_HID_KEY_STATS_READ, 2 * (LP_J - 1), 0, 0, 0);
+    CHECK_EQ(response_le16(3), 0);
+}
+
+TEST(key_stats_counters_saturate) {
+    for (uint32_t i = 0; i < UINT16_MAX + 10; ++i) {
+        key_stats_record_press(_QWERTY, LP_J - 1);
+    }
+    key_stats_record_press(_QWERTY, LP_K - 1);
+
+    request(RAW_HID_KEY_STATS_READ, 2 * (LP_J - 1), 0, 0, 0);
+    CHECK_EQ(response_le16(3), UINT16_MAX);
+    CHECK_EQ(response_le16(5), 1);
+}
+#    endif
+#endif
@@ -0,0 +1,102 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Keyboard report batching (report_batching.c).
+
+#include "keymap_test.h"
+
+#ifdef REPORT_BATCHING_ENABLE
+TEST(reports_in_one_iteration_are_merged) {
+    uint32_t start = sim_report_count;
+
+    sim_event(key_at(LP_A), true);
+    sim_event(key_at(LP_S), true);
+    sim_event(key_at(LP_D), true);
+    sim_task();
+    CHECK_EQ(sim_report_count - start, 1);
+    CHECK(sim_host_key(KC_A) && sim_host_key(KC_S) && sim_host_key(KC_D));
+
+    sim_event(key_at(LP_A), false);
+    sim_event(key_at(LP_S), false);
+    sim_event(key_at(LP_D), false);
+    sim_task();
+    CHECK_EQ(sim_report_count - start, 2);
+    CHECK(sim_host_idle());
+}
+
+TEST(reports_are_sent_in_the_same_iteration) {
+    uint32_t start = sim_report_count;
+    uint32_t now   = sim_now();
+
+    press(LP_A);
+    CHECK_EQ(sim_report_count - start, 1);
+    CHECK_EQ(sim_reports[start].time, now);
+    release(LP_A);
+}
+
+TEST(taps_within_one_iteration_are_not_lost) {
+    user_config.lang_switch_mode = LSW_MODE_CTRL_F15;
+    uint32_t start               = sim_report_count;
+
+    tap(LP_LSFT);
+    tap(LP_LSFT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_F15, MOD_BIT(KC_LCTL)), 1);
+    CHECK(sim_host_idle());
+}
+
+TEST(modifier_change_is_not_applied_to_earlier_keys) {
+    uint32_t start = sim_report_count;
+
+    sim_event(key_at(LP_A), true);
+    sim_event(key_at(LP_LCTL), true);
+    sim_task();
+
+    CHECK_EQ(sim_host_chords(start, KC_A, 0), 1);
+    CHECK_EQ(sim_host_chords(start, KC_A, MOD_BIT(KC_LCTL)), 0);
+    release(LP_A);
+    release(LP_LCTL);
+    CHECK(sim_host_idle());
+}
+
+// Return the index of the first report of the type starting from `start`.
+static uint32_t find_report(uint32_t start, sim_report_type_t type) {
+    while (start < sim_report_count && sim_reports[start].type != type) {
+        ++start;
+    }
+    return start;
+}
+
+TEST(modifiers_are_sent_before_mouse_and_extra_reports) {
+    press(LP_ESC);
+    sim_advance(TAPPING_TERM + 10);
+
+    // Ctrl+click (MB1 on _FN).
+    uint32_t start = sim_report_count;
+    sim_event(key_at(LP_LCTL), true);
+    sim_event(key_at(LP_Q), true);
+    sim_task();
+    uint32_t mouse = find_report(start, SIM_REPORT_MOUSE);
+    CHECK(mouse < sim_report_count && sim_reports[mouse].buttons == 1);
+    CHECK(find_report(start, SIM_REPORT_KEYBOARD) < mouse);
+    CHECK_EQ(sim_reports[find_report(start, SIM_REPORT_KEYBOARD)].mods, MOD_BIT(KC_LCTL));
+    release(LP_Q);
+    release(LP_LCTL);
+
+    // GUI+Volume Up (on _FN).
+    start = sim_report_count;
+    sim_event(key_at(LP_LGUI), true);
+    sim_event(key_at(LP_LBRC), true);
+    sim_task();
+    uint32_t extra = find_report(start, SIM_REPORT_EXTRA);
+    CHECK(extra < sim_report_count && sim_reports[extra].usage != 0);
+    CHECK(find_report(start, SIM_REPORT_KEYBOARD) < extra);
+    release(LP_LBRC);
+    release(LP_LGUI);
+
+    release(LP_ESC);
+    settle();
+    CHECK(sim_host_idle());
+}
+#endif
@@ -0,0 +1,121 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Tap dances: TD_RCTL (U_TRCTL) and the Shift tap dances as plain modifiers.
+
+#include "keymap_test.h"
+
+TEST(rctl_hold_activates_fn_layer) {
+    uint32_t start = sim_report_count;
+
+    press(LP_RCTL);
+    sim_advance(TAPPING_TERM + 10);
+    CHECK(layer_state_is(_FN));
+    tap(LP_J);
+    release(LP_RCTL);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_LEFT, 0), 1);
+    CHECK_EQ(sim_host_presses(start, KC_J), 0);
+    CHECK_EQ(sim_host_presses(start, KC_APP), 0);
+    CHECK_EQ(layer_state, 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(rctl_other_key_press_resolves_hold_immediately) {
+    uint32_t start = sim_report_count;
+
+    press(LP_RCTL);
+    sim_advance(30);
+    press(LP_J);
+    CHECK(layer_state_is(_FN));
+    CHECK(sim_host_key(KC_LEFT));
+    release(LP_J);
+    release(LP_RCTL);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_LEFT), 1);
+    CHECK_EQ(sim_host_presses(start, KC_J), 0);
+    CHECK_EQ(layer_state, 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(rctl_tap_sends_app) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RCTL);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_APP, 0), 1);
+    CHECK_EQ(sim_host_presses(start, KC_RCTL), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(rctl_double_tap_sends_rctl) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RCTL);
+    tap(LP_RCTL);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_RCTL), 1);
+    CHECK_EQ(sim_host_presses(start, KC_APP), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(rctl_tap_and_hold_is_ctrl_for_next_key) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RCTL);
+    press(LP_RCTL);
+    sim_advance(20);
+    tap(LP_J);
+    release(LP_RCTL);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_J, MOD_BIT(KC_RCTL)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_APP), 0);
+    CHECK_EQ(layer_state, 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(rctl_triple_tap_sends_app) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RCTL);
+    tap(LP_RCTL);
+    tap(LP_RCTL);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_APP, 0), 1);
+    CHECK_EQ(sim_host_presses(start, KC_RCTL), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(shift_tap_dance_holds_shift_immediately) {
+    uint32_t start = sim_report_count;
+
+    press(LP_LSFT);
+    CHECK(sim_host_key(KC_LSFT));
+    sim_advance(5);
+    tap(LP_A);
+    release(LP_LSFT);
+    settle();
+
+    CHECK_EQ(sim_host_chords(start, KC_A, MOD_BIT(KC_LSFT)), 1);
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
+
+TEST(shift_tap_dance_long_double_press_is_not_a_tap) {
+    uint32_t start = sim_report_count;
+
+    tap(LP_RSFT);
+    press(LP_RSFT);
+    sim_advance(TAPPING_TERM + 50);
+    release(LP_RSFT);
+    settle();
+
+    CHECK_EQ(sim_host_presses(start, KC_CAPS), 0);
+    CHECK(sim_host_idle());
+}
@@ -0,0 +1,139 @@
+// Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Settings store (user_settings.c): loading, migration and deferred writes.
+
+#include "keymap_test.h"
+
+// Same default as in user_settings.c.
+#ifndef USER_SETTINGS_FLUSH_DELAY
+#    define USER_SETTINGS_FLUSH_DELAY 3000
+#endif
+
+// Slot layout from user_settings.c: version, sequence, checksum (LE16), data.
+#define SLOT_VERSION 1 // USER_SETTINGS_VERSION
+#define SLOT_HEADER_SIZE 4
+
+static uint16_t slot_checksum(const uint8_t *slot) {
+    uint16_t sum1 = slot[0];
+    uint16_t sum2 = sum1;
+
+    sum1 = (sum1 + slot[1]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+    for (uint16_t i = SLOT_HEADER_SIZE; i < USER_SETTINGS_SLOT_SIZE; ++i) {
+        sum1 = (sum1 + slot[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+}
+
+// Write a slot with the specified contents (the data is zero padded).
+static void write_slot(uint8_t index, uint8_t version, uint8_t sequence, const void *data, size_t size) {
+    uint8_t *slot = &sim_eeprom_datablock[index * USER_SETTINGS_SLOT_SIZE];
+
+    memset(slot, 0, USER_SETTINGS_SLOT_SIZE);
+    slot[0] = version;
+    slot[1] = sequence;
+    memcpy(&slot[SLOT_HEADER_SIZE], data, size);
+    uint16_t checksum = slot_checksum(slot);
+    slot[2]           = checksum & 0xff;
+    slot[3]           = checksum >> 8;
+    sim_eeprom_datablock_valid = true;
+}
+
+static void restart(void) {
+    sim_init();
+}
+
+static void wait_for_flush(void) {
+    sim_advance(USER_SETTINGS_FLUSH_DELAY + 10);
+}
+
+TEST(defaults_are_written_to_empty_eeprom) {
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CAPS);
+    CHECK(sim_eeprom_datablock_valid);
+    wait_for_flush();
+    CHECK(sim_eeprom_bytes_written > 0);
+
+    user_config.lang_switch_mode = LSW_MODE_GUI_SPACE;
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CAPS);
+}
+
+TEST(legacy_lang_switch_mode_is_migrated) {
+    sim_eeprom_user = LSW_MODE_CTRL_F15;
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CTRL_F15);
+
+    wait_for_flush();
+    sim_eeprom_user = 0;
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CTRL_F15);
+}
+
+TEST(changes_are_written_only_after_idle_delay) {
+    wait_for_flush();
+    uint32_t written = sim_eeprom_bytes_written;
+
+    // Select the language switch mode 3 on the _ADJUST layer (Fn+Space, 4).
+    press(LP_ESC);
+    sim_advance(TAPPING_TERM + 10);
+    press(LP_SPC);
+    tap(LP_4);
+    release(LP_SPC);
+    release(LP_ESC);
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CTRL_SHIFT);
+
+    for (int i = 0; i < 10; ++i) {
+        sim_advance(USER_SETTINGS_FLUSH_DELAY / 2);
+        tap(LP_J);
+    }
+    CHECK_EQ(sim_eeprom_bytes_written, written);
+
+    wait_for_flush();
+    CHECK(sim_eeprom_bytes_written > written);
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CTRL_SHIFT);
+}
+
+TEST(newest_slot_is_used) {
+    user_config_t config = {0};
+
+    config.lang_switch_mode = LSW_MODE_ALT_SHIFT;
+    write_slot(0, SLOT_VERSION, 255, &config, sizeof(config));
+    config.lang_switch_mode = LSW_MODE_GUI_SPACE;
+    write_slot(1, SLOT_VERSION, 0, &config, sizeof(config)); // sequence wrapped around
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_GUI_SPACE);
+}
+
+TEST(torn_slot_write_is_ignored) {
+    user_config_t config = {0};
+
+    config.lang_switch_mode = LSW_MODE_ALT_SHIFT;
+    write_slot(0, SLOT_VERSION, 1, &config, sizeof(config));
+    config.lang_switch_mode = LSW_MODE_GUI_SPACE;
+    write_slot(1, SLOT_VERSION, 2, &config, sizeof(config));
+    // The data of the newer slot was changed, but the header was not written.
+    sim_eeprom_datablock[USER_SETTINGS_SLOT_SIZE + SLOT_HEADER_SIZE] = LSW_MODE_CTRL_SHIFT;
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_ALT_SHIFT);
+}
+
+TEST(settings_from_newer_firmware_are_ignored) {
+    user_config_t config = {0};
+
+    config.lang_switch_mode = LSW_MODE_ALT_SHIFT;
+    write_slot(0, SLOT_VERSION + 1, 1, &config, sizeof(config));
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CAPS);
+}
+
+TEST(settings_with_version_0_are_ignored) {
+    user_config_t config = {0};
+
+    config.lang_switch_mode = LSW_MODE_ALT_SHIFT;
+    write_slot(0, 0, 1, &config, sizeof(config));
+    restart();
+    CHECK_EQ(user_config.lang_switch_mode, LSW_MODE_CAPS);
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Copyright 2023 Sergey Vlasov <sigprof@gmail.com>
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Check the flash and RAM usage of the built firmware against the budgets.
+# Prints a Markdown table with the results; the exit status is nonzero if any
+# target is over its budget or has no budget.
+#
+# Usage: check_size_budgets.sh <budgets file> <.elf file>...
+
+budgets_file=$1
+shift
+
+# Print the flash and RAM budgets for the architecture ($1) and target ($2)
+# from the first matching line of the budgets file.
+get_budget() {
+    while read -r arch pattern flash ram; do
+        case $arch in
+            '' | '#'*) continue ;;
+        esac
+        [ "$arch" = "$1" ] || [ "$arch" = '*' ] || continue
+        # shellcheck disable=SC2254
+        case $2 in
+            $pattern)
+                echo "$flash $ram"
+                return 0
+                ;;
+        esac
+    done <"$budgets_file"
+    return 1
+}
+
+status=0
+echo '| Target | Flash | Flash budget | RAM | RAM budget | Result |'
+echo '|--------|------:|-------------:|----:|-----------:|--------|'
+for elf in "$@"; do
+    target=$(basename "$elf" .elf)
+
+    # ELF e_machine: 83 = AVR, 40 = ARM.
+    case $(od -An -tu2 -j18 -N2 "$elf" | tr -d ' ') in
+        83) arch=avr size_tool=avr-size ;;
+        40) arch=arm size_tool=arm-none-eabi-size ;;
+        *) arch=unknown size_tool=size ;;
+    esac
+
+    sizes=$("$size_tool" "$elf" | awk 'NR == 2 { print $1 + $2, $2 + $3 }')
+    flash=${sizes% *}
+    ram=${sizes#* }
+
+    if ! budget=$(get_budget "$arch" "$target"); then
+        echo "| $target | $flash | - | $ram | - | no budget for $arch |"
+        status=1
+        continue
+    fi
+    flash_budget=${budget% *}
+    ram_budget=${budget#* }
+
+    result=
+    if [ "$flash" -gt "$flash_budget" ]; then
+        result='flash over budget'
+    fi
+    if [ "$ram" -gt "$ram_budget" ]; then
+        result="${result:+$result, }RAM over budget"
+    fi
+    if [ -n "$result" ]; then
+        status=1
+    else
+        result=ok
+    fi
+    echo "| $target | $flash | $flash_budget | $ram | $ram_budget | $result |"
+done
+
+exit $status